@@ -0,0 +1,126 @@
+#include <cmath>
+#include <algorithm>
+#include "Accretion.h"
+#include "Parallel.h"
+
+namespace {
+	const float pi = 3.14159265358979f;
+}
+
+void Accretion::findMerges(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, float mergeSpeed) {
+	float mergeSpeedSquared = mergeSpeed * mergeSpeed;
+
+	contactMerges.resize(contacts.size());
+	parallelFor((unsigned int)contacts.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; c++) {
+			cy::Vec3f relativeVelocity = particles.getVelocity(contacts[c].second) - particles.getVelocity(contacts[c].first);
+			contactMerges[c] = relativeVelocity.Dot(relativeVelocity) < mergeSpeedSquared;
+		}
+	});
+
+	mergeContacts.clear();
+	for (size_t c = 0; c < contacts.size(); c++) {
+		if (contactMerges[c]) {
+			mergeContacts.push_back(contacts[c]);
+		}
+	}
+}
+
+size_t Accretion::merge(ParticleStore& particles, float density) {
+	absorbedParticles.clear();
+	mergedParticles.clear();
+	if (mergeContacts.empty()) {
+		return 0;
+	}
+
+	// join the picked contacts into groups, the lowest index of a group is its root
+	groupParents.resize(particles.size());
+	for (const std::pair<unsigned int, unsigned int>& contact : mergeContacts) {
+		groupParents[contact.first] = contact.first;
+		groupParents[contact.second] = contact.second;
+	}
+	for (const std::pair<unsigned int, unsigned int>& contact : mergeContacts) {
+		uint32_t first = findRoot(contact.first);
+		uint32_t second = findRoot(contact.second);
+		if (first != second) {
+			groupParents[std::max(first, second)] = std::min(first, second);
+		}
+	}
+
+	// list every particle once under its group
+	groupMembers.clear();
+	for (const std::pair<unsigned int, unsigned int>& contact : mergeContacts) {
+		groupMembers.push_back(((uint64_t)findRoot(contact.first) << 32) | contact.first);
+		groupMembers.push_back(((uint64_t)findRoot(contact.second) << 32) | contact.second);
+	}
+	std::sort(groupMembers.begin(), groupMembers.end());
+	groupMembers.erase(std::unique(groupMembers.begin(), groupMembers.end()), groupMembers.end());
+
+	groupStarts.clear();
+	for (size_t m = 0; m < groupMembers.size(); m++) {
+		if (m == 0 || (groupMembers[m] >> 32) != (groupMembers[m - 1] >> 32)) {
+			groupStarts.push_back((uint32_t)m);
+		}
+	}
+	groupStarts.push_back((uint32_t)groupMembers.size());
+
+	// the root comes first in its group and takes over the whole group, the groups share no particles
+	parallelFor((unsigned int)groupStarts.size() - 1, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int g = begin; g < end; g++) {
+			uint32_t root = (uint32_t)groupMembers[groupStarts[g]];
+
+			float mass = 0.0f;
+			cy::Vec3f momentum(0.0f, 0.0f, 0.0f);
+			cy::Vec3f position(0.0f, 0.0f, 0.0f);
+			cy::Vec3f previousPosition(0.0f, 0.0f, 0.0f);
+			for (uint32_t m = groupStarts[g]; m < groupStarts[g + 1]; m++) {
+				uint32_t i = (uint32_t)groupMembers[m];
+				mass += particles.mass[i];
+				momentum += particles.getVelocity(i) * particles.mass[i];
+				position += particles.getPosition(i) * particles.mass[i];
+				previousPosition += cy::Vec3f(particles.previousX[i], particles.previousY[i], particles.previousZ[i]) * particles.mass[i];
+			}
+			if (mass <= 0.0f) {
+				continue;
+			}
+
+			// a sphere of the same density as the pieces, the model scale grows with the radius
+			float radius = std::cbrt(3.0f * mass / (4.0f * pi * density));
+			if (particles.radius[root] > 0.0f) {
+				particles.scale[root] *= radius / particles.radius[root];
+			}
+
+			position /= mass;
+			previousPosition /= mass;
+			particles.x[root] = position.x;
+			particles.y[root] = position.y;
+			particles.z[root] = position.z;
+			particles.previousX[root] = previousPosition.x;
+			particles.previousY[root] = previousPosition.y;
+			particles.previousZ[root] = previousPosition.z;
+			particles.setVelocity(root, momentum / mass);
+			particles.radius[root] = radius;
+			particles.mass[root] = mass;
+		}
+	});
+
+	for (uint64_t member : groupMembers) {
+		uint32_t i = (uint32_t)member;
+		if (i != (uint32_t)(member >> 32)) {
+			absorbedParticles.push_back(i);
+		}
+		mergedParticles.push_back(i);
+	}
+	std::sort(absorbedParticles.begin(), absorbedParticles.end(), [](uint32_t a, uint32_t b) { return a > b; });
+
+	mergeContacts.clear();
+	return absorbedParticles.size();
+}
+
+uint32_t Accretion::findRoot(uint32_t i) {
+	while (groupParents[i] != i) {
+		groupParents[i] = groupParents[groupParents[i]];
+		i = groupParents[i];
+	}
+	return i;
+}
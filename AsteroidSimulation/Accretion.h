@@ -0,0 +1,45 @@
+#ifndef ACCRETION_H
+#define ACCRETION_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "ParticleStore.h"
+
+/// <summary>
+/// Merges fragments that meet slowly into single bodies. Contacts slower than the merge speed are picked
+/// before the contacts are resolved, chains of them are joined with union-find, and every group collapses into
+/// its lowest index particle, which takes the group's mass, momentum and centre of mass and the radius of a
+/// sphere of that mass. The groups are merged in parallel, and the absorbed particles are left for the caller
+/// to remove so it can keep its own per particle state in step.
+/// </summary>
+class Accretion {
+public:
+	// pick the contacts whose particles move slower than mergeSpeed relative to each other, call before the contacts are solved
+	void findMerges(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, float mergeSpeed);
+
+	// merge every group of picked contacts into one particle of the given density, particle indices must not have changed
+	// since findMerges, returns the number of particles absorbed
+	size_t merge(ParticleStore& particles, float density);
+
+	// particles absorbed by the last merge, highest index first so removing them in order never moves another one of them
+	const std::vector<uint32_t>& getAbsorbedParticles() const { return absorbedParticles; }
+
+	// every particle of the last merge's groups, the ones that took over their group included
+	const std::vector<uint32_t>& getMergedParticles() const { return mergedParticles; }
+
+private:
+	uint32_t findRoot(uint32_t i);
+
+	std::vector<unsigned char> contactMerges;
+	std::vector<std::pair<unsigned int, unsigned int>> mergeContacts;
+
+	std::vector<uint32_t> groupParents;  // union-find forest over the particles of the picked contacts
+	std::vector<uint64_t> groupMembers;  // group root in the high half and particle in the low half, sorted
+	std::vector<uint32_t> groupStarts;
+
+	std::vector<uint32_t> absorbedParticles;
+	std::vector<uint32_t> mergedParticles;
+};
+
+#endif
@@ -5,9 +5,12 @@
 * Final Project - Asteroid Simulation
 */
 
-#include <random>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 #include <GL/GL.h>
@@ -15,81 +18,11 @@
 #include "cyGL.h"
 #include "cyMatrix.h"
 #include "lodepng.h"
-
-/// <summary>
-/// Asteroid class for manipulating asteroid particles
-/// </summary>
-class Asteroid {
-public:
-	cy::Matrix4f modelMatrix;
-	cy::Vec3f velocity;
-	float radius;
-	float mass;
-	bool updated = false;
-
-	Asteroid() {
-		modelMatrix = cy::Matrix4f(1.0f);
-		velocity.Zero();
-		radius = 0.0f;
-		mass = 0.0f;
-	}
-
-	void updateVelocity(Asteroid& other) {
-		cy::Vec3f momentum = mass * velocity + other.mass * other.velocity;
-		cy::Vec3f centerOfMassVelocity = momentum / (mass + other.mass);
-
-		cy::Vec3f firstCMVelocity = velocity - centerOfMassVelocity;
-		cy::Vec3f secondCMVelocity = other.velocity - centerOfMassVelocity;
-
-		if (!updated) {
-			cy::Vec3f firstCMVelocityNew = (firstCMVelocity * (mass - other.mass) + 2 * other.mass * secondCMVelocity) / (mass + other.mass);
-			cy::Vec3f firstVelocityNew = firstCMVelocityNew + firstCMVelocity;
-			velocity = firstVelocityNew;
-			updated = true;
-		}
-		if (!other.updated) {
-			cy::Vec3f secondCMVelocityNew = (secondCMVelocity * (other.mass - mass) + 2 * mass * firstCMVelocity) / (mass + other.mass);
-			cy::Vec3f secondVelocityNew = secondCMVelocityNew + secondCMVelocity;
-			other.velocity = secondVelocityNew;
-			other.updated = true;
-		}
-	}
-
-	void updatePosition() {
-		modelMatrix.AddTranslation(velocity);
-	}
-
-	void move(cy::Vec3f translation) {
-		modelMatrix.AddTranslation(translation);
-	}
-
-	void scale(float amount) {
-		modelMatrix.SetScale(amount);
-	}
-
-	bool checkCollision(const Asteroid& other) const {
-		cy::Vec3f currentAsteroidCenter = modelMatrix.GetTranslation();
-		cy::Vec3f otherAsteroidCenter = other.modelMatrix.GetTranslation();
-
-		// compute distance between model's centers
-		float dx = otherAsteroidCenter.x - currentAsteroidCenter.x;
-		float dy = otherAsteroidCenter.y - currentAsteroidCenter.y;
-		float dz = otherAsteroidCenter.z - currentAsteroidCenter.z;
-		float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
-
-		float radiusSum = radius + other.radius;
-
-		if (distance <= radiusSum) {
-			// asteroids are colliding
-			return true;
-		}
-		else {
-			// asteroids are NOT colliding
-			return false;
-		}
-	}
-};
-
+#include "ParticleSnapshot.h"
+#include "TripleBuffer.h"
+#include "NarrowPhase.h"
+#include "Simulation.h"
+#include "Parallel.h"
 
 // callbacks
 void render();
@@ -102,18 +35,18 @@ void idle();
 // helpers
 void initialize();
 void update();
+void startSimulationThread();
+void stopSimulationThread();
+void simulationLoop();
+void publishSnapshot();
 void loadSkybox();
 void loadAsteroids();
 void buildSkyboxShaders();
-void buildFirstAsteroidShaders();
-void buildSecondAsteroidShaders();
+void buildAsteroidShaders();
 float toRadians(float degrees);
 void resetSimulation();
-bool checkCollision();
 float getModelRadius(const std::vector<cy::Vec3f>& vertices, float scale);
-void generateParticles(cy::Vec3f startingPosition, unsigned int particleNum, std::vector<Asteroid>& asteroidParticles, bool isFirst);
-float getRandomFloat(float min, float max);
-double estimateMass(double radius);
+cy::Vec3f interpolate(const cy::Vec3f& previous, const cy::Vec3f& current, float interpolation);
 
 // space skybox enviroment
 cy::GLSLProgram skyboxProgram;
@@ -139,7 +72,7 @@ std::vector<unsigned char> spaceFace4;
 std::vector<unsigned char> spaceFace5;
 std::vector<unsigned char> spaceFace6;
 
-// both asteroids
+// every asteroid and fragment
 std::vector<cy::Vec3f> asteroidVertices;
 cy::TriMesh asteroidMesh;
 
@@ -153,50 +86,71 @@ unsigned asteroidHeightWidth, asteroidHeightHeight = 2048;
 
 float radiusScale = 0.65f;
 
-bool exploded = false;
-bool particlesGenerated = false;
-
-float asteroidDensity = 1000.0f;
+cy::GLSLProgram asteroidProgram;
 
-// asteroid 1
-cy::GLSLProgram firstAsteroidProgram;
+GLuint asteroidVAO;
+GLuint asteroidVBO;
 
-GLuint firstAsteroidVAO;
-GLuint firstAsteroidVBO;
+cy::Matrix4f asteroidViewMatrix;
+cy::Matrix4f asteroidProjMatrix;
+cy::Matrix4f asteroidRotationMatrix;
 
-cy::Matrix4f firstAsteroidMVPMatrix;
-cy::Matrix4f firstAsteroidViewMatrix;
-cy::Matrix4f firstAsteroidProjMatrix;
-cy::Matrix4f firstAsteroidRotationMatrix;
-cy::Matrix4f firstAsteroidModelMatrix;
+// the scenario, a particle's parent is the index of the asteroid it broke off from
+std::vector<ParentBody> parentBodies = {
+	{
+		cy::Vec3f(-4.0f, -2.0f, 0.0f), cy::Vec3f(0.005f, 0.0025f, 0.0f), .02f, 320,
+		{
+			0.0001f, 0.0015f,                                                   // scale
+			cy::Vec3f(-1.5f, -1.5f, -1.5f), cy::Vec3f(0.25f, 0.25f, 0.25f),     // position
+			cy::Vec3f(-0.05f, -0.05f, -0.05f), cy::Vec3f(0.01f, 0.01f, 0.1f)    // velocity
+		}
+	},
+	{
+		cy::Vec3f(3.5f, 2.0f, 0.0f), cy::Vec3f(-0.005f, -0.0025f, 0.0f), .015f, 260,
+		{
+			0.0001f, 0.0015f,                                                   // scale
+			cy::Vec3f(-0.25f, -0.25f, -0.25f), cy::Vec3f(1.5f, 1.5f, 1.5f),     // position
+			cy::Vec3f(-0.01f, -0.01f, -0.05f), cy::Vec3f(0.05f, 0.05f, 0.1f)    // velocity
+		}
+	}
+};
 
-float firstAsteroidRadius;
+Simulation simulation; // stepped by the simulation thread only
 
-float firstAsteroidScale = .02f;
+unsigned int physicsThreadCount = 0; // 0 uses every hardware thread
 
-unsigned int firstAstroidParticleNum = 320;
+// fixed timestep physics on its own thread
+float maxFrameTime = 0.25f; // longest the physics falls behind before it drops time, so a stall does not snowball into more steps
 
-std::vector<Asteroid> firstAsteroidParticles;
+/// <summary>
+/// Everything drawing needs from one physics step
+/// </summary>
+struct SimulationSnapshot {
+	ParticleSnapshot particles;
 
-// asteroid 2
-cy::GLSLProgram secondAsteroidProgram;
+	// one of each per parent body
+	std::vector<cy::Matrix4f> parentModelMatrices;
+	std::vector<cy::Vec3f> parentPreviousPositions;
+	std::vector<unsigned char> parentExploded;
 
-GLuint secondAsteroidVAO;
-GLuint secondAsteroidVBO;
+	std::chrono::steady_clock::time_point stepTime; // when the step finished, frames after it are drawn towards it
 
-cy::Matrix4f secondAsteroidMVPMatrix;
-cy::Matrix4f secondAsteroidViewMatrix;
-cy::Matrix4f secondAsteroidProjMatrix;
-cy::Matrix4f secondAsteroidRotationMatrix;
-cy::Matrix4f secondAsteroidModelMatrix;
+	// telemetry
+	unsigned int substeps = 1;
+	unsigned int blockLevel = 0;
+	size_t awakeParticles = 0;
+	float stepMilliseconds = 0.0f;
+};
 
-float secondAsteroidRadius;
+TripleBuffer<SimulationSnapshot> renderSnapshots; // written by the simulation thread, read by render
 
-float secondAsteroidScale = .015f;
+std::thread simulationThread;
+std::atomic<bool> simulationRunning(false);
+std::atomic<bool> resetRequested(false); // set by the input callbacks, the simulation thread resets before its next step
 
-unsigned int secondAstroidParticleNum = 260;
+float physicsInterpolation = 0.0f; // how far the drawn frame is between the last two physics states
 
-std::vector<Asteroid> secondAsteroidParticles;
+std::chrono::steady_clock::time_point telemetryTime; // when the window title last showed the telemetry
 
 // display window
 float windowWidth = 1024;
@@ -217,10 +171,7 @@ float currAngleX, currAngleY; // current x and y value for left click
 
 float motionScale = .2;
 
-bool simulating = false;
-
-const double pi = 3.14159;
-
+std::atomic<bool> simulating(false);
 
 int main(int argc, char** argv)
 {
@@ -261,6 +212,8 @@ void render() {
 
 	update();
 
+	const SimulationSnapshot& snapshot = renderSnapshots.getReadBuffer();
+
 	glDepthMask(GL_FALSE);
 
 	// draw space enviroment sky box
@@ -274,49 +227,29 @@ void render() {
 	glDrawArrays(GL_TRIANGLES, 0, 36);
 	glDepthMask(GL_TRUE);
 
-	if (!exploded) {
-		// draw first asteroid
-		firstAsteroidProgram.Bind();
-
-		GLuint firstAsteroidMVP = glGetUniformLocation(firstAsteroidProgram.GetID(), "mvp");
-		glUniformMatrix4fv(firstAsteroidMVP, 1, GL_FALSE, &firstAsteroidMVPMatrix(0, 0));
-
-		glBindVertexArray(firstAsteroidVAO);
-		glDrawArrays(GL_TRIANGLES, 0, asteroidVertices.size());
+	asteroidProgram.Bind();
+	glBindVertexArray(asteroidVAO);
+	GLuint asteroidMVP = glGetUniformLocation(asteroidProgram.GetID(), "mvp");
 
-		// draw second asteroid
-		secondAsteroidProgram.Bind();
+	// draw the asteroids still in one piece
+	for (size_t b = 0; b < snapshot.parentModelMatrices.size(); b++) {
+		if (snapshot.parentExploded[b]) {
+			continue;
+		}
 
-		GLuint secondAsteroidMVP = glGetUniformLocation(secondAsteroidProgram.GetID(), "mvp");
-		glUniformMatrix4fv(secondAsteroidMVP, 1, GL_FALSE, &secondAsteroidMVPMatrix(0, 0));
+		cy::Matrix4f drawMatrix = snapshot.parentModelMatrices[b];
+		drawMatrix.SetTranslationComponent(interpolate(snapshot.parentPreviousPositions[b], drawMatrix.GetTranslation(), physicsInterpolation));
 
-		glBindVertexArray(secondAsteroidVAO);
+		cy::Matrix4f mvp = asteroidProjMatrix * asteroidViewMatrix * drawMatrix * asteroidRotationMatrix;
+		glUniformMatrix4fv(asteroidMVP, 1, GL_FALSE, &mvp(0, 0));
 		glDrawArrays(GL_TRIANGLES, 0, asteroidVertices.size());
 	}
-	else {
-		// draw first asteroid's particles
-		firstAsteroidProgram.Bind();
-
-		for (const Asteroid& asteroid : firstAsteroidParticles) {
-			cy::Matrix4f mvp = firstAsteroidProjMatrix * firstAsteroidViewMatrix * asteroid.modelMatrix * firstAsteroidRotationMatrix;
-			GLuint asteroidParticleMVP = glGetUniformLocation(firstAsteroidProgram.GetID(), "mvp");
-			glUniformMatrix4fv(asteroidParticleMVP, 1, GL_FALSE, &mvp(0, 0));
 
-			glBindVertexArray(firstAsteroidVAO);
-			glDrawArrays(GL_TRIANGLES, 0, asteroidVertices.size());
-		}
-
-		// draw second asteroid's particles
-		secondAsteroidProgram.Bind();
-
-		for (const Asteroid& asteroid : secondAsteroidParticles) {
-			cy::Matrix4f mvp = secondAsteroidProjMatrix * secondAsteroidViewMatrix * asteroid.modelMatrix * secondAsteroidRotationMatrix;
-			GLuint asteroidParticleMVP = glGetUniformLocation(secondAsteroidProgram.GetID(), "mvp");
-			glUniformMatrix4fv(asteroidParticleMVP, 1, GL_FALSE, &mvp(0, 0));
-
-			glBindVertexArray(secondAsteroidVAO);
-			glDrawArrays(GL_TRIANGLES, 0, asteroidVertices.size());
-		}
+	// draw the fragments of every asteroid
+	for (size_t i = 0; i < snapshot.particles.size(); i++) {
+		cy::Matrix4f mvp = asteroidProjMatrix * asteroidViewMatrix * snapshot.particles.getModelMatrix(i, physicsInterpolation) * asteroidRotationMatrix;
+		glUniformMatrix4fv(asteroidMVP, 1, GL_FALSE, &mvp(0, 0));
+		glDrawArrays(GL_TRIANGLES, 0, asteroidVertices.size());
 	}
 
 	// swap buffers
@@ -390,41 +323,30 @@ void resetSimulation() {
 	skyboxProjMatrix.SetPerspective(45.0f, (GLfloat)windowWidth / (GLfloat)windowHeight, 0.1f, 100.0f);
 	skyboxRotationMatrix.SetRotationXYZ(cameraX, cameraY, 0.0f);
 
-	// first asteroid matrices
-	firstAsteroidMVPMatrix = cy::Matrix4f(1.0f);
-	firstAsteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
-	firstAsteroidProjMatrix.SetPerspective(45.0f, (GLfloat)windowWidth / (GLfloat)windowHeight, 0.1f, 100.0f);
-	firstAsteroidRotationMatrix.SetRotationXYZ(cameraX, cameraY, 0.0f);
-	firstAsteroidModelMatrix = cy::Matrix4f(1.0f);
-	firstAsteroidModelMatrix.SetScale(firstAsteroidScale);
-	firstAsteroidModelMatrix.AddTranslation(cy::Vec3f(-4.0f, -2.0f, 0.0f));
-
-	// second asteroid matrices
-	secondAsteroidMVPMatrix = cy::Matrix4f(1.0f);
-	secondAsteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
-	secondAsteroidProjMatrix.SetPerspective(45.0f, (GLfloat)windowWidth / (GLfloat)windowHeight, 0.1f, 100.0f);
-	secondAsteroidRotationMatrix.SetRotationXYZ(cameraX, cameraY, 0.0f);
-	secondAsteroidModelMatrix = cy::Matrix4f(1.0f);
-	secondAsteroidModelMatrix.SetScale(secondAsteroidScale);
-	secondAsteroidModelMatrix.AddTranslation(cy::Vec3f(3.5f, 2.0f, 0.0f));
+	// asteroid matrices, shared by every asteroid and fragment
+	asteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
+	asteroidProjMatrix.SetPerspective(45.0f, (GLfloat)windowWidth / (GLfloat)windowHeight, 0.1f, 100.0f);
+	asteroidRotationMatrix.SetRotationXYZ(cameraX, cameraY, 0.0f);
 
+	// the simulation thread owns the asteroids and particles
 	simulating = false;
-	exploded = false;
-	particlesGenerated = false;
-
-	firstAsteroidParticles.clear();
-	secondAsteroidParticles.clear();
+	resetRequested = true;
 }
 
 void initialize() {
+	setWorkerCount(physicsThreadCount);
 	resetSimulation();
 
 	buildSkyboxShaders();
-	buildFirstAsteroidShaders();
-	buildSecondAsteroidShaders();
+	buildAsteroidShaders();
 
 	loadSkybox();
 	loadAsteroids();
+
+	std::cout << "Narrow phase collision tests use " << getSphereTestKernelName() << "." << std::endl;
+	std::cout << "Physics runs on " << getWorkerCount() << " threads at " << simulation.stepRate << " steps per second." << std::endl;
+
+	startSimulationThread();
 }
 
 void update() {
@@ -433,58 +355,94 @@ void update() {
 	skyboxRotationMatrix.SetRotationXYZ(toRadians(cameraX), toRadians(cameraY), 0.0f);
 	skyboxMVPMatrix = skyboxProjMatrix * skyboxViewMatrix * cy::Matrix4f(1.0f) * skyboxRotationMatrix;
 
-	// update first asteroid matrices
-	firstAsteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
-	firstAsteroidRotationMatrix.SetRotationXYZ(toRadians(cameraX), toRadians(cameraY), 0.0f);
-	firstAsteroidMVPMatrix = firstAsteroidProjMatrix * firstAsteroidViewMatrix * firstAsteroidModelMatrix * firstAsteroidRotationMatrix;
-
-	// update second asteroid matrices
-	secondAsteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
-	secondAsteroidRotationMatrix.SetRotationXYZ(toRadians(cameraX), toRadians(cameraY), 0.0f);
-	secondAsteroidMVPMatrix = secondAsteroidProjMatrix * secondAsteroidViewMatrix * secondAsteroidModelMatrix * secondAsteroidRotationMatrix;
-
-	//// update first asteroids particle's positions and velocites
-	for (Asteroid& asteroid : firstAsteroidParticles) {
-		for (Asteroid& otherAsteroid : secondAsteroidParticles) {
-			if (asteroid.checkCollision(otherAsteroid)) {
-				asteroid.updateVelocity(otherAsteroid);
-			}
-		}
+	// take the newest physics step without waiting for the simulation thread, and draw the time since it between its two states
+	renderSnapshots.update();
+	const SimulationSnapshot& snapshot = renderSnapshots.getReadBuffer();
 
-		asteroid.updatePosition();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	float sinceStep = std::chrono::duration<float>(now - snapshot.stepTime).count();
+	physicsInterpolation = std::min(sinceStep * simulation.stepRate, 1.0f);
+
+	// show the physics cost in the title bar, twice a second so it stays readable
+	if (now - telemetryTime > std::chrono::milliseconds(500)) {
+		char title[128];
+		snprintf(title, sizeof(title), "Asteroid Simulation - %u substeps, %u block levels, %zu of %zu fragments awake, %.2f ms per step",
+			snapshot.substeps, snapshot.blockLevel, snapshot.awakeParticles, snapshot.particles.size(), snapshot.stepMilliseconds);
+		glutSetWindowTitle(title);
+		telemetryTime = now;
 	}
 
-	// update second asteroids particle's positions and velocities
-	for (Asteroid& asteroid : secondAsteroidParticles) {
-		for (Asteroid& otherAsteroid : firstAsteroidParticles) {
-			if (asteroid.checkCollision(otherAsteroid)) {
-				asteroid.updateVelocity(otherAsteroid);
-			}
-		}
+	// update asteroid matrices, each asteroid's own part is added when it is drawn
+	asteroidViewMatrix.SetView(cameraPos, cy::Vec3f(0.0f, 0.0f, 0.0f), cy::Vec3f(0.0f, 1.0f, 0.0f));
+	asteroidRotationMatrix.SetRotationXYZ(toRadians(cameraX), toRadians(cameraY), 0.0f);
+}
 
-		asteroid.updatePosition();
-	}
+void startSimulationThread() {
+	// render has a snapshot to draw before the first step
+	resetRequested = false;
+	simulation.setParentBodies(parentBodies);
+	simulation.reset();
+	publishSnapshot();
 
-	// set updated to false for next time
-	for (Asteroid& asteroid : firstAsteroidParticles) {
-		asteroid.updated = false;
-	}
-	for (Asteroid& asteroid : secondAsteroidParticles) {
-		asteroid.updated = false;
+	simulationRunning = true;
+	simulationThread = std::thread(simulationLoop);
+
+	// glut exits the process from inside its main loop, the thread has to be joined before that
+	atexit(stopSimulationThread);
+}
+
+void stopSimulationThread() {
+	simulationRunning = false;
+	if (simulationThread.joinable()) {
+		simulationThread.join();
 	}
+}
 
-	if (simulating && !exploded) {
-		// move asteroids towards eachother
-		firstAsteroidModelMatrix.AddTranslation(cy::Vec3f(0.005f, 0.0025f, 0.0));
-		secondAsteroidModelMatrix.AddTranslation(cy::Vec3f(-0.005f, -0.0025f, 0.0));
+void simulationLoop() {
+	std::chrono::steady_clock::duration stepDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / simulation.stepRate));
+	std::chrono::steady_clock::duration maxLag = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(maxFrameTime));
+	std::chrono::steady_clock::time_point nextStepTime = std::chrono::steady_clock::now();
+
+	while (simulationRunning) {
+		if (resetRequested.exchange(false)) {
+			simulation.reset();
+		}
+
+		// every step covers the same time, so the simulation does not depend on the display rate
+		simulation.setParentsMoving(simulating);
+		simulation.step(1);
+		publishSnapshot();
+
+		nextStepTime += stepDuration;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - nextStepTime > maxLag) {
+			nextStepTime = now;
+		}
+		std::this_thread::sleep_until(nextStepTime);
 	}
+}
 
-	if (checkCollision() && !particlesGenerated) {
-		// explode asteroids and make smaller particles
-		exploded = true;
-		generateParticles(firstAsteroidModelMatrix.GetTranslation(), firstAstroidParticleNum, firstAsteroidParticles, true);
-		generateParticles(secondAsteroidModelMatrix.GetTranslation(), secondAstroidParticleNum, secondAsteroidParticles, false);
+void publishSnapshot() {
+	SimulationSnapshot& snapshot = renderSnapshots.getWriteBuffer();
+
+	const std::vector<ParentBody>& bodies = simulation.getParentBodies();
+
+	snapshot.particles.capture(simulation.getParticles());
+	snapshot.parentModelMatrices.resize(bodies.size());
+	snapshot.parentPreviousPositions.resize(bodies.size());
+	snapshot.parentExploded.resize(bodies.size());
+	for (size_t b = 0; b < bodies.size(); b++) {
+		snapshot.parentModelMatrices[b] = bodies[b].modelMatrix;
+		snapshot.parentPreviousPositions[b] = bodies[b].previousPosition;
+		snapshot.parentExploded[b] = bodies[b].exploded;
 	}
+	snapshot.substeps = simulation.getSubsteps();
+	snapshot.blockLevel = simulation.getBlockLevel();
+	snapshot.awakeParticles = simulation.getAwakeParticles();
+	snapshot.stepMilliseconds = simulation.getStepMilliseconds();
+	snapshot.stepTime = std::chrono::steady_clock::now();
+
+	renderSnapshots.publish();
 }
 
 void loadSkybox()
@@ -585,92 +543,27 @@ void loadAsteroids()
 		asteroidVertices.push_back(asteroidMesh.V(asteroidMesh.F(i).v[2])); //store vertex 3
 	}
 
-	firstAsteroidRadius = getModelRadius(asteroidVertices, firstAsteroidScale);
-	secondAsteroidRadius = getModelRadius(asteroidVertices, secondAsteroidScale);
+	simulation.asteroidModelRadius = getModelRadius(asteroidVertices, 1.0f);
 
-	// first asteroid
-	glGenVertexArrays(1, &firstAsteroidVAO);
-	glBindVertexArray(firstAsteroidVAO);
+	// every asteroid and fragment draws the same mesh
+	glGenVertexArrays(1, &asteroidVAO);
+	glBindVertexArray(asteroidVAO);
 
-	glGenBuffers(1, &firstAsteroidVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, firstAsteroidVBO);
+	glGenBuffers(1, &asteroidVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, asteroidVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(cy::Vec3f) * asteroidVertices.size(), &asteroidVertices[0], GL_STATIC_DRAW);
 
-	GLuint firstAsteroidPos = glGetAttribLocation(firstAsteroidProgram.GetID(), "pos");
-	glEnableVertexAttribArray(firstAsteroidPos);
-	glBindBuffer(GL_ARRAY_BUFFER, firstAsteroidVBO);
-	glVertexAttribPointer(firstAsteroidPos, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-	// second asteroid
-	glGenVertexArrays(1, &secondAsteroidVAO);
-	glBindVertexArray(secondAsteroidVAO);
-
-	glGenBuffers(1, &secondAsteroidVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, secondAsteroidVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cy::Vec3f) * asteroidVertices.size(), &asteroidVertices[0], GL_STATIC_DRAW);
+	GLuint asteroidPos = glGetAttribLocation(asteroidProgram.GetID(), "pos");
+	glEnableVertexAttribArray(asteroidPos);
+	glBindBuffer(GL_ARRAY_BUFFER, asteroidVBO);
+	glVertexAttribPointer(asteroidPos, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
 
-	GLuint secondAsteroidPos = glGetAttribLocation(secondAsteroidProgram.GetID(), "pos");
-	glEnableVertexAttribArray(secondAsteroidPos);
-	glBindBuffer(GL_ARRAY_BUFFER, firstAsteroidVBO);
-	glVertexAttribPointer(secondAsteroidPos, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-	firstAsteroidProgram["asteroidTexture"] = 1;
-	secondAsteroidProgram["asteroidTexture"] = 1;
-
-	firstAsteroidProgram["asteroidDisplacement"] = 2;
-	secondAsteroidProgram["asteroidDisplacement"] = 2;
+	asteroidProgram["asteroidTexture"] = 1;
+	asteroidProgram["asteroidDisplacement"] = 2;
 
 	std::cout << "Finished loading asteroids." << std::endl;
 }
 
-bool checkCollision() {
-	cy::Vec3f firstAsteroidCenter = firstAsteroidModelMatrix.GetTranslation();
-	cy::Vec3f secondAsteroidCenter = secondAsteroidModelMatrix.GetTranslation();
-
-	// compute distance between model'c centers
-	float dx = secondAsteroidCenter.x - firstAsteroidCenter.x;
-	float dy = secondAsteroidCenter.y - firstAsteroidCenter.y;
-	float dz = secondAsteroidCenter.z - firstAsteroidCenter.z;
-	float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
-
-	float radiusSum = firstAsteroidRadius + secondAsteroidRadius;
-
-	if (distance <= radiusSum) {
-		// asteroids are colliding
-		return true;
-	}
-	else {
-		// asteroids are NOT colliding
-		return false;
-	}
-}
-
-void generateParticles(cy::Vec3f startingPosition, unsigned int particleNum, std::vector<Asteroid> &asteroidParticles, bool isFirst) {
-
-	for (int i = 0; i < particleNum; i++) {
-		Asteroid asteroidParticle;
-		float scale = getRandomFloat(.0001, .0015);
-		asteroidParticle.scale(scale);
-		asteroidParticle.radius = getModelRadius(asteroidVertices, scale);
- 		asteroidParticle.mass = estimateMass(asteroidParticle.radius);
-
-		if (isFirst) {
-			// first astoroid particles
-			asteroidParticle.move(cy::Vec3f(getRandomFloat(-1.5f, 0.25f), getRandomFloat(-1.5f, 0.25f), getRandomFloat(-1.5f, 0.25f)));
-			asteroidParticle.velocity = cy::Vec3f(getRandomFloat(-0.05f, 0.01f), getRandomFloat(-0.05f, 0.01f), getRandomFloat(-0.05f, 0.1f));
-		}
-		else {
-			// second astroid particles
-			asteroidParticle.move(cy::Vec3f(getRandomFloat(-0.25f, 1.5f), getRandomFloat(-0.25f, 1.5f), getRandomFloat(-0.25f, 1.5f)));
-			asteroidParticle.velocity = cy::Vec3f(getRandomFloat(-0.01f, 0.05f), getRandomFloat(-0.01f, 0.05f), getRandomFloat(-0.05f, 0.1f));
-		}
-
-		asteroidParticles.push_back(asteroidParticle);
-	}
-
-	particlesGenerated = true;
-}
-
 float getModelRadius(const std::vector<cy::Vec3f>& vertices, float scale) {
 	float radius = 0.0f;
 
@@ -691,17 +584,10 @@ void buildSkyboxShaders() {
 	}
 }
 
-void buildFirstAsteroidShaders() {
-	bool firstAsteroidShadersCompiled = firstAsteroidProgram.BuildFiles("asteroid1.vert", "asteroid1.frag");
-	if (!firstAsteroidShadersCompiled) {
-		std::cout << "First asteroid shaders failed to compile!" << std::endl;
-	}
-}
-
-void buildSecondAsteroidShaders() {
-	bool secondAsteroidShadersCompiled = secondAsteroidProgram.BuildFiles("asteroid2.vert", "asteroid2.frag");
-	if (!secondAsteroidShadersCompiled) {
-		std::cout << "Second asteroid shaders failed to compile!" << std::endl;
+void buildAsteroidShaders() {
+	bool asteroidShadersCompiled = asteroidProgram.BuildFiles("asteroid.vert", "asteroid.frag");
+	if (!asteroidShadersCompiled) {
+		std::cout << "Asteroid shaders failed to compile!" << std::endl;
 	}
 }
 
@@ -709,18 +595,7 @@ float toRadians(float degrees) {
 	return degrees * (3.41159264 / 180);
 }
 
-/// <summary>
-/// Random number that is more likely to be towards the center of the min and max
-/// </summary>
-float getRandomFloat(float min, float max) {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::normal_distribution<float> distribution((min + max) / 2.0f, (max - min) / 3.0f);
-	return distribution(gen);
+cy::Vec3f interpolate(const cy::Vec3f& previous, const cy::Vec3f& current, float interpolation) {
+	return previous + (current - previous) * interpolation;
 }
 
-double estimateMass(double radius) {
-	double volume = (4.0 / 3.0) * pi * pow(radius, 3.0);
-	double mass = asteroidDensity * volume;
-	return mass;
-}
\ No newline at end of file
@@ -0,0 +1,445 @@
+#include <cmath>
+#include <algorithm>
+#include "BarnesHutTree.h"
+#include "Parallel.h"
+#include "MortonCode.h"
+
+namespace {
+	cy::Vec3f minimum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+	}
+
+	cy::Vec3f maximum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+	}
+}
+
+void BarnesHutTree::build(const ParticleStore& particles) {
+	nodes.clear();
+	if (particles.size() == 0) {
+		return;
+	}
+
+	sortParticles(particles);
+
+	Node root;
+	root.size = rootSize;
+	root.firstChild = 0;
+	root.childCount = 0;
+	root.begin = 0;
+	root.end = (uint32_t)particles.size();
+	nodes.push_back(root);
+
+	// split the top of the tree serially, every cell that still needs splitting at parallelDepth becomes a task
+	std::vector<uint32_t> taskNodes;
+	std::vector<uint32_t> level(1, 0);
+	for (int depth = 0; depth < parallelDepth && !level.empty(); depth++) {
+		std::vector<uint32_t> nextLevel;
+		for (uint32_t node : level) {
+			if (nodes[node].end - nodes[node].begin <= leafSize) {
+				continue;
+			}
+			splitNode(nodes, node, depth);
+			for (uint32_t child = 0; child < nodes[node].childCount; child++) {
+				nextLevel.push_back(nodes[node].firstChild + child);
+			}
+		}
+		level.swap(nextLevel);
+	}
+	uint32_t topNodeCount = (uint32_t)nodes.size();
+
+	for (uint32_t node : level) {
+		if (nodes[node].end - nodes[node].begin > leafSize) {
+			taskNodes.push_back(node);
+		}
+	}
+
+	// each task builds its subtree into its own array with the task cell at index 0
+	std::vector<std::vector<Node>> subtrees(taskNodes.size());
+	parallelFor((unsigned int)taskNodes.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int task = begin; task < end; task++) {
+			subtrees[task].push_back(nodes[taskNodes[task]]);
+			buildSubtree(subtrees[task], 0, parallelDepth);
+		}
+	});
+
+	// move the subtrees in behind the top of the tree, in task order so the layout does not depend on the thread count
+	for (size_t task = 0; task < taskNodes.size(); task++) {
+		std::vector<Node>& subtree = subtrees[task];
+		uint32_t offset = (uint32_t)nodes.size() - 1;
+		for (Node& node : subtree) {
+			if (node.childCount > 0) {
+				node.firstChild += offset;
+			}
+		}
+		nodes[taskNodes[task]] = subtree[0];
+		nodes.insert(nodes.end(), subtree.begin() + 1, subtree.end());
+	}
+
+	// children of the top cells always have higher indices, so one backwards pass sums them bottom up
+	for (uint32_t node = topNodeCount; node-- > 0;) {
+		if (nodes[node].childCount == 0) {
+			sumLeaf(nodes[node]);
+		}
+		else {
+			sumChildren(nodes, nodes[node]);
+		}
+	}
+}
+
+void BarnesHutTree::refit(const ParticleStore& particles) {
+	if (particles.size() != sortedPositions.size() || nodes.empty()) {
+		build(particles);
+		return;
+	}
+
+	parallelFor((unsigned int)particles.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int k = begin; k < end; k++) {
+			sortedPositions[k] = particles.getPosition(sortedParticles[k]);
+			sortedMasses[k] = particles.mass[sortedParticles[k]];
+		}
+	});
+
+	// every cell's children have higher indices than the cell, so one backwards pass sums them bottom up
+	for (uint32_t node = (uint32_t)nodes.size(); node-- > 0;) {
+		if (nodes[node].childCount == 0) {
+			sumLeaf(nodes[node]);
+		}
+		else {
+			sumChildren(nodes, nodes[node]);
+		}
+	}
+}
+
+void BarnesHutTree::refit(const ParticleStore& particles, const std::vector<unsigned char>& levels, unsigned int levelCount) {
+	refit(particles);
+	if (nodes.empty()) {
+		return;
+	}
+
+	summedLevels = levelCount;
+	sortedLevels.resize(particles.size());
+	parallelFor((unsigned int)particles.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int k = begin; k < end; k++) {
+			sortedLevels[k] = levels[sortedParticles[k]];
+		}
+	});
+
+	deepestLevels.resize(nodes.size());
+	levelSums.resize(nodes.size() * summedLevels);
+	for (uint32_t node = (uint32_t)nodes.size(); node-- > 0;) {
+		sumLevels(node);
+	}
+}
+
+void BarnesHutTree::computeAccelerations(const ParticleStore& particles, const std::vector<uint32_t>& active, float gravitationalConstant, float openingAngle, float softening, std::vector<cy::Vec3f>& accelerations) const {
+	accelerations.resize(active.size());
+	if (nodes.empty()) {
+		std::fill(accelerations.begin(), accelerations.end(), cy::Vec3f(0.0f, 0.0f, 0.0f));
+		return;
+	}
+
+	float openingAngleSquared = openingAngle * openingAngle;
+	float softeningSquared = softening * softening;
+
+	parallelFor((unsigned int)active.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int n = begin; n < end; n++) {
+			unsigned int i = active[n];
+			accelerations[n] = gravitationalConstant * computeAcceleration(sortedIndices[i], particles.getPosition(i), openingAngleSquared, softeningSquared);
+		}
+	});
+}
+
+void BarnesHutTree::computeKicks(const ParticleStore& particles, const std::vector<uint32_t>& targets, const float* pairKicks, float gravitationalConstant, float openingAngle, float softening, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations) const {
+	kicks.resize(targets.size());
+	if (accelerations) {
+		accelerations->resize(targets.size());
+	}
+	if (nodes.empty()) {
+		std::fill(kicks.begin(), kicks.end(), cy::Vec3f(0.0f, 0.0f, 0.0f));
+		if (accelerations) {
+			std::fill(accelerations->begin(), accelerations->end(), cy::Vec3f(0.0f, 0.0f, 0.0f));
+		}
+		return;
+	}
+
+	float openingAngleSquared = openingAngle * openingAngle;
+	float softeningSquared = softening * softening;
+
+	parallelFor((unsigned int)targets.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int n = begin; n < end; n++) {
+			unsigned int i = targets[n];
+			cy::Vec3f acceleration(0.0f, 0.0f, 0.0f);
+			kicks[n] = gravitationalConstant * computeKick(sortedIndices[i], particles.getPosition(i), pairKicks, openingAngleSquared, softeningSquared, accelerations ? &acceleration : nullptr);
+			if (accelerations) {
+				(*accelerations)[n] = gravitationalConstant * acceleration;
+			}
+		}
+	});
+}
+
+cy::Vec3f BarnesHutTree::computeAcceleration(uint32_t k, const cy::Vec3f& position, float openingAngleSquared, float softeningSquared) const {
+	uint32_t stack[8 * (maxDepth + 1)];
+
+	cy::Vec3f acceleration(0.0f, 0.0f, 0.0f);
+
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+
+		if (node.childCount == 0) {
+			for (uint32_t q = node.begin; q < node.end; q++) {
+				if (q == k) {
+					continue;
+				}
+				cy::Vec3f offset = sortedPositions[q] - position;
+				float inverseDistance = 1.0f / std::sqrt(offset.Dot(offset) + softeningSquared);
+				acceleration += offset * (sortedMasses[q] * inverseDistance * inverseDistance * inverseDistance);
+			}
+			continue;
+		}
+
+		cy::Vec3f offset = node.centerOfMass - position;
+		float distanceSquared = offset.Dot(offset);
+		if (node.size * node.size < openingAngleSquared * distanceSquared) {
+			// far enough away to use the whole cell at once
+			float inverseDistance = 1.0f / std::sqrt(distanceSquared + softeningSquared);
+			acceleration += offset * (node.mass * inverseDistance * inverseDistance * inverseDistance);
+			continue;
+		}
+
+		for (uint32_t child = 0; child < node.childCount; child++) {
+			stack[stackSize++] = node.firstChild + child;
+		}
+	}
+
+	return acceleration;
+}
+
+cy::Vec3f BarnesHutTree::computeKick(uint32_t k, const cy::Vec3f& position, const float* pairKicks, float openingAngleSquared, float softeningSquared, cy::Vec3f* acceleration) const {
+	uint32_t stack[8 * (maxDepth + 1)];
+
+	unsigned int level = sortedLevels[k];
+	cy::Vec3f kick(0.0f, 0.0f, 0.0f);
+
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		uint32_t nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+
+		// the times only grow with the level, so a cell whose deepest particles have no time with k has none at all
+		unsigned int deepestLevel = deepestLevels[nodeIndex];
+		if (pairKicks[std::max(level, deepestLevel)] == 0.0f) {
+			continue;
+		}
+
+		if (node.childCount == 0) {
+			for (uint32_t q = node.begin; q < node.end; q++) {
+				float pairKick = pairKicks[std::max(level, (unsigned int)sortedLevels[q])];
+				if (q == k || pairKick == 0.0f) {
+					continue;
+				}
+				cy::Vec3f offset = sortedPositions[q] - position;
+				float inverseDistance = 1.0f / std::sqrt(offset.Dot(offset) + softeningSquared);
+				cy::Vec3f pull = offset * (sortedMasses[q] * inverseDistance * inverseDistance * inverseDistance);
+				kick += pull * pairKick;
+				if (acceleration) {
+					*acceleration += pull;
+				}
+			}
+			continue;
+		}
+
+		cy::Vec3f offset = node.centerOfMass - position;
+		float distanceSquared = offset.Dot(offset);
+		if (node.size * node.size < openingAngleSquared * distanceSquared) {
+			// far enough away to use the whole cell at once, the particles up to k's level share k's time and each
+			// deeper level has its own, so those act as separate masses
+			const LevelSum* sums = &levelSums[nodeIndex * summedLevels];
+			if (pairKicks[level] > 0.0f) {
+				cy::Vec3f weighted(0.0f, 0.0f, 0.0f);
+				float mass = 0.0f;
+				for (unsigned int sumLevel = 0; sumLevel <= std::min(level, deepestLevel); sumLevel++) {
+					weighted += sums[sumLevel].weighted;
+					mass += sums[sumLevel].mass;
+				}
+				if (mass > 0.0f) {
+					kick += computePull(weighted, mass, position, softeningSquared) * pairKicks[level];
+				}
+			}
+			for (unsigned int sumLevel = level + 1; sumLevel <= deepestLevel; sumLevel++) {
+				if (sums[sumLevel].mass > 0.0f && pairKicks[sumLevel] > 0.0f) {
+					kick += computePull(sums[sumLevel].weighted, sums[sumLevel].mass, position, softeningSquared) * pairKicks[sumLevel];
+				}
+			}
+
+			if (acceleration) {
+				float inverseDistance = 1.0f / std::sqrt(distanceSquared + softeningSquared);
+				*acceleration += offset * (node.mass * inverseDistance * inverseDistance * inverseDistance);
+			}
+			continue;
+		}
+
+		for (uint32_t child = 0; child < node.childCount; child++) {
+			stack[stackSize++] = node.firstChild + child;
+		}
+	}
+
+	return kick;
+}
+
+cy::Vec3f BarnesHutTree::computePull(const cy::Vec3f& weighted, float mass, const cy::Vec3f& position, float softeningSquared) {
+	cy::Vec3f offset = weighted / mass - position;
+	float inverseDistance = 1.0f / std::sqrt(offset.Dot(offset) + softeningSquared);
+	return offset * (mass * inverseDistance * inverseDistance * inverseDistance);
+}
+
+void BarnesHutTree::sortParticles(const ParticleStore& particles) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	unsigned int chunkCount = getWorkerCount();
+	std::vector<cy::Vec3f> chunkMin(chunkCount, particles.getPosition(0));
+	std::vector<cy::Vec3f> chunkMax(chunkCount, particles.getPosition(0));
+
+	// bounds of the particle centers
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)particleCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)particleCount * (chunk + 1) / chunkCount);
+			for (unsigned int i = begin; i < end; i++) {
+				chunkMin[chunk] = minimum(chunkMin[chunk], particles.getPosition(i));
+				chunkMax[chunk] = maximum(chunkMax[chunk], particles.getPosition(i));
+			}
+		}
+	});
+
+	cy::Vec3f sceneMin = chunkMin[0];
+	cy::Vec3f sceneMax = chunkMax[0];
+	for (unsigned int chunk = 1; chunk < chunkCount; chunk++) {
+		sceneMin = minimum(sceneMin, chunkMin[chunk]);
+		sceneMax = maximum(sceneMax, chunkMax[chunk]);
+	}
+
+	// the root is a cube so the cells at every depth are cubes too
+	float scale = 1023.0f / std::max((sceneMax - sceneMin).Max(), 1e-6f);
+	rootSize = 1024.0f / scale;
+
+	mortonCodes.resize(particleCount);
+	sortedParticles.resize(particleCount);
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			mortonCodes[i] = getMortonCode(particles.getPosition(i), sceneMin, scale);
+			sortedParticles[i] = i;
+		}
+	});
+
+	parallelRadixSort(mortonCodes, sortedParticles, codeScratch, particleScratch, 3 * maxDepth);
+
+	// copy the positions and masses into Morton order so the leaves read contiguous memory
+	sortedPositions.resize(particleCount);
+	sortedMasses.resize(particleCount);
+	sortedIndices.resize(particleCount);
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int k = begin; k < end; k++) {
+			sortedPositions[k] = particles.getPosition(sortedParticles[k]);
+			sortedMasses[k] = particles.mass[sortedParticles[k]];
+			sortedIndices[sortedParticles[k]] = k;
+		}
+	});
+}
+
+void BarnesHutTree::splitNode(std::vector<Node>& tree, uint32_t nodeIndex, int depth) const {
+	Node node = tree[nodeIndex];
+	int shift = 3 * (maxDepth - 1 - depth);
+
+	node.firstChild = (uint32_t)tree.size();
+	node.childCount = 0;
+
+	// the codes are sorted, so each child is the run of particles sharing the next three bits
+	uint32_t begin = node.begin;
+	while (begin < node.end) {
+		uint32_t nextChildCode = ((mortonCodes[begin] >> shift) + 1) << shift;
+		uint32_t end = (uint32_t)(std::lower_bound(mortonCodes.begin() + begin, mortonCodes.begin() + node.end, nextChildCode) - mortonCodes.begin());
+
+		Node child;
+		child.size = 0.5f * node.size;
+		child.firstChild = 0;
+		child.childCount = 0;
+		child.begin = begin;
+		child.end = end;
+		tree.push_back(child);
+
+		node.childCount++;
+		begin = end;
+	}
+
+	tree[nodeIndex] = node;
+}
+
+void BarnesHutTree::buildSubtree(std::vector<Node>& tree, uint32_t nodeIndex, int depth) const {
+	if (tree[nodeIndex].end - tree[nodeIndex].begin <= leafSize || depth == maxDepth) {
+		sumLeaf(tree[nodeIndex]);
+		return;
+	}
+
+	splitNode(tree, nodeIndex, depth);
+
+	uint32_t firstChild = tree[nodeIndex].firstChild;
+	uint32_t childCount = tree[nodeIndex].childCount;
+	for (uint32_t child = 0; child < childCount; child++) {
+		buildSubtree(tree, firstChild + child, depth + 1);
+	}
+
+	sumChildren(tree, tree[nodeIndex]);
+}
+
+void BarnesHutTree::sumLeaf(Node& node) const {
+	node.mass = 0.0f;
+	cy::Vec3f weighted(0.0f, 0.0f, 0.0f);
+	for (uint32_t k = node.begin; k < node.end; k++) {
+		node.mass += sortedMasses[k];
+		weighted += sortedPositions[k] * sortedMasses[k];
+	}
+	node.centerOfMass = node.mass > 0.0f ? weighted / node.mass : sortedPositions[node.begin];
+}
+
+void BarnesHutTree::sumChildren(const std::vector<Node>& tree, Node& node) const {
+	node.mass = 0.0f;
+	cy::Vec3f weighted(0.0f, 0.0f, 0.0f);
+	for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+		node.mass += tree[child].mass;
+		weighted += tree[child].centerOfMass * tree[child].mass;
+	}
+	node.centerOfMass = node.mass > 0.0f ? weighted / node.mass : tree[node.firstChild].centerOfMass;
+}
+
+void BarnesHutTree::sumLevels(uint32_t nodeIndex) {
+	const Node& node = nodes[nodeIndex];
+	LevelSum* sums = &levelSums[nodeIndex * summedLevels];
+	for (unsigned int level = 0; level < summedLevels; level++) {
+		sums[level].weighted = cy::Vec3f(0.0f, 0.0f, 0.0f);
+		sums[level].mass = 0.0f;
+	}
+
+	unsigned char deepestLevel = 0;
+	if (node.childCount == 0) {
+		for (uint32_t k = node.begin; k < node.end; k++) {
+			LevelSum& sum = sums[sortedLevels[k]];
+			sum.weighted += sortedPositions[k] * sortedMasses[k];
+			sum.mass += sortedMasses[k];
+			deepestLevel = std::max(deepestLevel, sortedLevels[k]);
+		}
+	}
+	else {
+		for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+			const LevelSum* childSums = &levelSums[child * summedLevels];
+			for (unsigned int level = 0; level <= deepestLevels[child]; level++) {
+				sums[level].weighted += childSums[level].weighted;
+				sums[level].mass += childSums[level].mass;
+			}
+			deepestLevel = std::max(deepestLevel, deepestLevels[child]);
+		}
+	}
+	deepestLevels[nodeIndex] = deepestLevel;
+}
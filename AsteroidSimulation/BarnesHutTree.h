@@ -0,0 +1,93 @@
+#ifndef BARNES_HUT_TREE_H
+#define BARNES_HUT_TREE_H
+
+#include <vector>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Octree for mutual gravity between particles. Distant cells act as a single mass at their center of
+/// mass, so each step costs O(N log N) instead of testing every pair. The tree is rebuilt every step
+/// from the Morton order of the particles, with the subtrees built in parallel, and refit to the moved
+/// particles between the evaluations of a step.
+/// </summary>
+class BarnesHutTree {
+public:
+	// rebuild the tree over the particle positions and masses
+	void build(const ParticleStore& particles);
+
+	// move the masses to the particles' current positions and sum the cells again, the cells keep their particles and
+	// sizes so this is much cheaper than build while the particles moved little since, rebuilds if particles were added or removed
+	void refit(const ParticleStore& particles);
+
+	// refit and also sum the cells separately for each of the levelCount levels of the particles, which computeKicks needs
+	void refit(const ParticleStore& particles, const std::vector<unsigned char>& levels, unsigned int levelCount);
+
+	// gravitational acceleration of only the active particles at their current positions, accelerations[n] belongs
+	// to particle active[n], the tree keeps the masses where build or refit last found them, a cell is treated as a
+	// single mass once its size over its distance drops below openingAngle, softening keeps close pairs finite
+	void computeAccelerations(const ParticleStore& particles, const std::vector<uint32_t>& active, float gravitationalConstant, float openingAngle, float softening, std::vector<cy::Vec3f>& accelerations) const;
+
+	// velocity change of only the target particles, kicks[n] belongs to particle targets[n], every other particle j pulls
+	// target i for pairKicks[max(level i, level j)] with the levels of the last refit, a pair's time is the same from
+	// both sides so their pulls cancel, pairKicks must be zero up to some level and positive from there on, pairs with
+	// a zero time are skipped, accelerations gets the plain acceleration of each target when it is not null and no time is zero
+	void computeKicks(const ParticleStore& particles, const std::vector<uint32_t>& targets, const float* pairKicks, float gravitationalConstant, float openingAngle, float softening, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations) const;
+
+private:
+	static const unsigned int leafSize = 8;
+	static const int maxDepth = 10;       // the Morton codes hold 10 levels
+	static const int parallelDepth = 2;   // cells at this depth are built as separate tasks
+
+	struct Node {
+		cy::Vec3f centerOfMass;
+		float mass;
+		float size;          // edge length of the cell
+		uint32_t firstChild; // children are stored next to each other
+		uint32_t childCount; // 0 for leaves
+		uint32_t begin;      // sorted particles inside the cell
+		uint32_t end;
+	};
+
+	void sortParticles(const ParticleStore& particles);
+	void splitNode(std::vector<Node>& tree, uint32_t nodeIndex, int depth) const;
+	void buildSubtree(std::vector<Node>& tree, uint32_t nodeIndex, int depth) const;
+	void sumLeaf(Node& node) const;
+	void sumChildren(const std::vector<Node>& tree, Node& node) const;
+	void sumLevels(uint32_t nodeIndex);
+
+	// pull on position of a mass whose mass weighted position sum is weighted, with a gravitational constant of 1
+	static cy::Vec3f computePull(const cy::Vec3f& weighted, float mass, const cy::Vec3f& position, float softeningSquared);
+
+	// acceleration at position of sorted particle k with a gravitational constant of 1, k's own mass is skipped
+	cy::Vec3f computeAcceleration(uint32_t k, const cy::Vec3f& position, float openingAngleSquared, float softeningSquared) const;
+
+	// velocity change of sorted particle k for computeKicks with a gravitational constant of 1, adds the plain acceleration when it is not null
+	cy::Vec3f computeKick(uint32_t k, const cy::Vec3f& position, const float* pairKicks, float openingAngleSquared, float softeningSquared, cy::Vec3f* acceleration) const;
+
+	float rootSize = 0.0f;
+
+	std::vector<uint32_t> mortonCodes;
+	std::vector<uint32_t> sortedParticles;
+	std::vector<uint32_t> sortedIndices; // where each particle landed in sortedParticles
+	std::vector<uint32_t> codeScratch;
+	std::vector<uint32_t> particleScratch;
+
+	std::vector<cy::Vec3f> sortedPositions;
+	std::vector<float> sortedMasses;
+
+	std::vector<Node> nodes; // the root is node 0
+
+	// per level sums of the last refit with levels
+	struct LevelSum {
+		cy::Vec3f weighted; // mass weighted sum of the positions of the cell's particles on the level
+		float mass;
+	};
+	unsigned int summedLevels = 0;
+	std::vector<unsigned char> sortedLevels;
+	std::vector<unsigned char> deepestLevels; // of each cell
+	std::vector<LevelSum> levelSums;          // summedLevels per cell
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include <cmath>
+#include <algorithm>
+#include "BlockTimestepIntegrator.h"
+#include "Parallel.h"
+
+void BlockTimestepIntegrator::beginStep(ParticleStore& particles, float timeStep, float maxTravel, float accuracy, float softening, unsigned int levelLimit, const AccelerationFunction& computeAccelerations, const KickFunction& computeKicks) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	if (levelLimit > maxLevel) {
+		levelLimit = maxLevel;
+	}
+	stepLength = timeStep;
+
+	// the steps are picked from the accelerations the last step ended with, particles added since then get theirs on their own
+	if (accelerations.size() > particleCount) {
+		clear();
+	}
+	accelerations.resize(particleCount);
+	accelerationKnown.resize(particleCount, 0);
+
+	active.clear();
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!accelerationKnown[i]) {
+			active.push_back(i);
+		}
+	}
+	bool added = !active.empty();
+	if (added) {
+		computeAccelerations(particles, active, activeAccelerations);
+		for (size_t n = 0; n < active.size(); n++) {
+			accelerations[active[n]] = activeAccelerations[n];
+			accelerationKnown[active[n]] = 1;
+		}
+	}
+
+	levels.resize(particleCount);
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			if (particles.asleep[i]) {
+				levels[i] = 0;
+				continue;
+			}
+
+			float speed = particles.getVelocity(i).Length();
+			float acceleration = accelerations[i].Length();
+
+			float step = timeStep;
+			if (speed > 0.0f) {
+				step = std::min(step, maxTravel * particles.radius[i] / speed);
+			}
+			if (acceleration > 0.0f) {
+				step = std::min(step, accuracy * std::sqrt(softening / acceleration));
+			}
+
+			unsigned int level = 0;
+			while (level < levelLimit && timeStep / (float)(1u << level) > step) {
+				level++;
+			}
+			levels[i] = (unsigned char)level;
+		}
+	});
+
+	// group the awake particles by level with a counting sort, deepest first so every tick's active particles are one prefix
+	levelStarts.assign(maxLevel + 2, 0);
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!particles.asleep[i]) {
+			levelStarts[maxLevel - levels[i] + 1]++;
+		}
+	}
+	for (unsigned int slot = 1; slot < levelStarts.size(); slot++) {
+		levelStarts[slot] += levelStarts[slot - 1];
+	}
+
+	levelParticles.resize(particleCount);
+	active.assign(levelStarts.begin(), levelStarts.end() - 1);
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!particles.asleep[i]) {
+			levelParticles[active[maxLevel - levels[i]]++] = i;
+		}
+	}
+
+	deepestLevel = 0;
+	while (deepestLevel < maxLevel && levelStarts[maxLevel - deepestLevel] > 0) {
+		deepestLevel++;
+	}
+
+	// opening half kick, while every awake particle shares one step the accelerations the last step ended with give
+	// each pair the same kick from both sides, otherwise each pair is kicked for half the shorter step of the two
+	unsigned int awakeCount = levelStarts[maxLevel + 1];
+	if (!added && levelStarts[maxLevel - deepestLevel + 1] == awakeCount) {
+		float kick = 0.5f * timeStep / (float)(1u << deepestLevel);
+		parallelFor(awakeCount, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = begin; n < end; n++) {
+				unsigned int i = levelParticles[n];
+				particles.setVelocity(i, particles.getVelocity(i) + accelerations[i] * kick);
+			}
+		});
+		return;
+	}
+
+	for (unsigned int level = 0; level <= maxLevel; level++) {
+		pairKicks[level] = 0.5f * timeStep / (float)(1u << level);
+	}
+	active.assign(levelParticles.begin(), levelParticles.begin() + awakeCount);
+	computeKicks(particles, active, levels, pairKicks, kicks, nullptr);
+
+	parallelFor(awakeCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int n = begin; n < end; n++) {
+			unsigned int i = active[n];
+			particles.setVelocity(i, particles.getVelocity(i) + kicks[n]);
+		}
+	});
+}
+
+void BlockTimestepIntegrator::finishStep(ParticleStore& particles, const KickFunction& computeKicks) {
+	unsigned int tickCount = 1u << deepestLevel;
+	unsigned int awakeCount = levelStarts[maxLevel + 1];
+	float tickLength = stepLength / (float)tickCount;
+
+	// every tick pulls on every awake particle, the pairs whose shorter step does not end on it skip out
+	active.assign(levelParticles.begin(), levelParticles.begin() + awakeCount);
+
+	for (unsigned int tick = 1; tick <= tickCount; tick++) {
+		// a particle's step ends on this tick when its step length in ticks divides the tick, so the levels at or
+		// below the tick's trailing zero count are done
+		unsigned int trailingZeros = 0;
+		while (trailingZeros < deepestLevel && (tick & (1u << trailingZeros)) == 0) {
+			trailingZeros++;
+		}
+		unsigned int shallowestLevel = deepestLevel - trailingZeros;
+
+		// inside the step the closing and next opening half kicks add up to a full kick, the last tick only closes
+		bool lastTick = tick == tickCount;
+		for (unsigned int level = 0; level <= maxLevel; level++) {
+			pairKicks[level] = level < shallowestLevel ? 0.0f : stepLength / (float)(1u << level);
+			if (lastTick) {
+				pairKicks[level] *= 0.5f;
+			}
+		}
+
+		// every awake particle drifts on every tick, so the pulls of a tick are between particles at the same moment
+		parallelFor(awakeCount, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = begin; n < end; n++) {
+				unsigned int i = active[n];
+				particles.x[i] += particles.vx[i] * tickLength;
+				particles.y[i] += particles.vy[i] * tickLength;
+				particles.z[i] += particles.vz[i] * tickLength;
+			}
+		});
+
+		// the accelerations the step ends with pick the next step's levels
+		computeKicks(particles, active, levels, pairKicks, kicks, lastTick ? &activeAccelerations : nullptr);
+
+		parallelFor(awakeCount, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = begin; n < end; n++) {
+				unsigned int i = active[n];
+				particles.setVelocity(i, particles.getVelocity(i) + kicks[n]);
+				if (lastTick) {
+					accelerations[i] = activeAccelerations[n];
+				}
+			}
+		});
+	}
+}
+
+void BlockTimestepIntegrator::evaluateSleeping(const ParticleStore& particles, const AccelerationFunction& computeAccelerations) {
+	active.clear();
+	for (uint32_t i = 0; i < (uint32_t)accelerations.size(); i++) {
+		if (particles.asleep[i]) {
+			active.push_back(i);
+		}
+	}
+	if (active.empty()) {
+		return;
+	}
+
+	computeAccelerations(particles, active, activeAccelerations);
+	for (size_t n = 0; n < active.size(); n++) {
+		accelerations[active[n]] = activeAccelerations[n];
+	}
+}
+
+void BlockTimestepIntegrator::clear() {
+	accelerations.clear();
+	accelerationKnown.clear();
+}
+
+void BlockTimestepIntegrator::removeParticle(const ParticleStore& particles, uint32_t i) {
+	// particles added since the last step have no acceleration yet, the one moved into i's place may be one of them
+	accelerations.resize(particles.size());
+	accelerationKnown.resize(particles.size(), 0);
+
+	accelerations[i] = accelerations.back();
+	accelerationKnown[i] = accelerationKnown.back();
+	accelerations.pop_back();
+	accelerationKnown.pop_back();
+}
@@ -0,0 +1,73 @@
+#ifndef BLOCK_TIMESTEP_INTEGRATOR_H
+#define BLOCK_TIMESTEP_INTEGRATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Kick-drift-kick leapfrog with power of two block timesteps. Each particle steps by the whole step
+/// over a power of two picked from its speed and acceleration, so the few fast or closely passing
+/// fragments take many short steps while quiet ones take a single long step. A pair of particles is kicked
+/// on the shorter step of the two, from both sides at once, and every awake particle drifts on every tick,
+/// so the pulls of a pair always cancel and the steps conserve momentum. Sleeping particles are not moved or kicked.
+/// </summary>
+class BlockTimestepIntegrator {
+public:
+	// must set accelerations[n] to the acceleration of particle active[n], pulled by the other particles at their current positions
+	typedef std::function<void(const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations)> AccelerationFunction;
+
+	// must set kicks[n] to the velocity change of particle targets[n], every other particle j pulls target i from its
+	// current position for pairKicks[max(levels[i], levels[j])] of time, which is zero up to the levels whose steps do not
+	// end on the tick, and must set accelerations like an AccelerationFunction when it is not null
+	typedef std::function<void(const ParticleStore& particles, const std::vector<uint32_t>& targets, const std::vector<unsigned char>& levels, const float* pairKicks, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations)> KickFunction;
+
+	static const unsigned int maxLevel = 8; // the shortest step is the whole step over 2^maxLevel
+
+	// pick every particle's step and give it the opening half kick, a particle's step moves it at most maxTravel
+	// of its radii and is at most accuracy * sqrt(softening / acceleration) but no shorter than the whole step over
+	// 2^levelLimit, levelLimit is clamped to maxLevel, velocity changes such as collisions can be applied between
+	// beginStep and finishStep
+	void beginStep(ParticleStore& particles, float timeStep, float maxTravel, float accuracy, float softening, unsigned int levelLimit, const AccelerationFunction& computeAccelerations, const KickFunction& computeKicks);
+
+	// drift every awake particle through the step tick by tick, kicking each pair whenever the shorter step of the
+	// two ends, every awake particle ends its last step on the final tick
+	void finishStep(ParticleStore& particles, const KickFunction& computeKicks);
+
+	// evaluate the accelerations of the sleeping particles, which the steps skip, with the sources of the current step
+	void evaluateSleeping(const ParticleStore& particles, const AccelerationFunction& computeAccelerations);
+
+	// forget the accelerations kept from the last step, call when particles were moved or replaced outside the integrator,
+	// particles added since the last step do not need it
+	void clear();
+
+	// keep the accelerations in step with ParticleStore::remove, call right before it
+	void removeParticle(const ParticleStore& particles, uint32_t i);
+
+	// the last step was split into 2^level ticks
+	unsigned int getDeepestLevel() const { return deepestLevel; }
+
+	// of every particle at the end of its last step, sleepers keep theirs from the last evaluateSleeping
+	const std::vector<cy::Vec3f>& getAccelerations() const { return accelerations; }
+
+private:
+	float stepLength = 0.0f;
+	unsigned int deepestLevel = 0;
+
+	std::vector<cy::Vec3f> accelerations;         // of every particle at the end of its last step
+	std::vector<unsigned char> accelerationKnown; // 0 for particles added since the last step
+	std::vector<unsigned char> levels;
+
+	std::vector<uint32_t> levelParticles; // particles grouped by level, deepest first
+	std::vector<uint32_t> levelStarts;    // first entry of each level in levelParticles, maxLevel + 2 entries
+
+	float pairKicks[maxLevel + 1] = {}; // time the pairs of each level are kicked for on the current tick
+
+	std::vector<uint32_t> active;
+	std::vector<cy::Vec3f> activeAccelerations;
+	std::vector<cy::Vec3f> kicks;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include "ContactSolver.h"
+#include "Parallel.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	unsigned int countTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctzll(value);
+#endif
+	}
+}
+
+void ContactSolver::solve(ParticleStore& particles, std::vector<std::pair<unsigned int, unsigned int>>& contacts) {
+	// a fixed contact order makes the sums below independent of how the pairs were found
+	std::sort(contacts.begin(), contacts.end());
+
+	solveSorted(particles, contacts, nullptr);
+}
+
+void ContactSolver::solve(ParticleStore& particles, std::vector<std::pair<unsigned int, unsigned int>>& contacts, std::vector<float>& impactTimes) {
+	contactOrder.resize(contacts.size());
+	for (unsigned int c = 0; c < contactOrder.size(); c++) {
+		contactOrder[c] = c;
+	}
+	std::sort(contactOrder.begin(), contactOrder.end(), [&](uint32_t a, uint32_t b) {
+		return contacts[a] < contacts[b];
+	});
+
+	sortedContacts.resize(contacts.size());
+	sortedImpactTimes.resize(contacts.size());
+	for (unsigned int c = 0; c < contactOrder.size(); c++) {
+		sortedContacts[c] = contacts[contactOrder[c]];
+		sortedImpactTimes[c] = impactTimes[contactOrder[c]];
+	}
+	contacts.swap(sortedContacts);
+	impactTimes.swap(sortedImpactTimes);
+
+	solveSorted(particles, contacts, &impactTimes);
+}
+
+void ContactSolver::solveSorted(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, const std::vector<float>* impactTimes) {
+	unsigned int contactCount = (unsigned int)contacts.size();
+
+	particleColors.resize(particles.size());
+	for (const std::pair<unsigned int, unsigned int>& contact : contacts) {
+		particleColors[contact.first] = 0;
+		particleColors[contact.second] = 0;
+	}
+
+	// every contact takes the lowest color neither of its particles has yet, in contact order so the colors are always the same
+	contactColors.resize(contactCount);
+	colorStarts.assign(colorCount + 2, 0);
+	for (unsigned int c = 0; c < contactCount; c++) {
+		unsigned int i = contacts[c].first;
+		unsigned int j = contacts[c].second;
+
+		uint64_t free = ~(particleColors[i] | particleColors[j]);
+		unsigned int color = free ? countTrailingZeros(free) : colorCount;
+		if (color < colorCount) {
+			particleColors[i] |= 1ull << color;
+			particleColors[j] |= 1ull << color;
+		}
+
+		contactColors[c] = (unsigned char)color;
+		colorStarts[color + 1]++;
+	}
+	for (unsigned int color = 1; color < colorStarts.size(); color++) {
+		colorStarts[color] += colorStarts[color - 1];
+	}
+
+	colorContacts.resize(contactCount);
+	colorEnds.assign(colorStarts.begin(), colorStarts.end() - 1);
+	for (unsigned int c = 0; c < contactCount; c++) {
+		colorContacts[colorEnds[contactColors[c]]++] = c;
+	}
+
+	// the contacts of a color share no particle, so they are solved at the same time
+	for (unsigned int color = 0; color < colorCount; color++) {
+		unsigned int first = colorStarts[color];
+		parallelFor(colorStarts[color + 1] - first, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = first + begin; n < first + end; n++) {
+				unsigned int c = colorContacts[n];
+				solveContact(particles, contacts[c].first, contacts[c].second, impactTimes ? (*impactTimes)[c] : 0.0f);
+			}
+		});
+	}
+
+	// a particle with more contacts than colors, the rest of them go one by one
+	for (unsigned int n = colorStarts[colorCount]; n < colorStarts[colorCount + 1]; n++) {
+		unsigned int c = colorContacts[n];
+		solveContact(particles, contacts[c].first, contacts[c].second, impactTimes ? (*impactTimes)[c] : 0.0f);
+	}
+}
+
+void ContactSolver::solveContact(ParticleStore& particles, unsigned int i, unsigned int j, float impactTime) const {
+	// overlapping particles that already move apart are left alone, otherwise they would bounce back and forth,
+	// swept contacts are judged where the spheres touch
+	cy::Vec3f relativeVelocity = particles.getVelocity(j) - particles.getVelocity(i);
+	cy::Vec3f normal = particles.getPosition(j) - particles.getPosition(i) + relativeVelocity * impactTime;
+	if (normal.Dot(relativeVelocity) >= 0.0f) {
+		return;
+	}
+
+	cy::Vec3f deltaI, deltaJ;
+	particles.getCollisionResponse(i, j, deltaI, deltaJ);
+
+	particles.setVelocity(i, particles.getVelocity(i) + deltaI);
+	particles.setVelocity(j, particles.getVelocity(j) + deltaJ);
+
+	// the position update moves by the new velocity for the whole step, take back the part before the touch
+	particles.x[i] -= deltaI.x * impactTime;
+	particles.y[i] -= deltaI.y * impactTime;
+	particles.z[i] -= deltaI.z * impactTime;
+	particles.x[j] -= deltaJ.x * impactTime;
+	particles.y[j] -= deltaJ.y * impactTime;
+	particles.z[j] -= deltaJ.z * impactTime;
+}
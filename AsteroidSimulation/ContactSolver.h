@@ -0,0 +1,45 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Resolves a list of particle contacts in parallel. The contacts are colored greedily in contact order so
+/// that no two contacts of a color share a particle, then the colors are solved one after another with the
+/// contacts of each color on all cores. Every contact gives both of its particles their full, opposite
+/// response from the velocities the earlier colors left, so momentum is kept and the result is the same
+/// for any thread count. Contacts that are already separating are skipped.
+/// Swept contacts also carry the time into the step they touch, a particle keeps its old velocity up to the
+/// touch and moves with the new one for the rest of the step.
+/// </summary>
+class ContactSolver {
+public:
+	// contacts are sorted in place, each pair must have i < j
+	void solve(ParticleStore& particles, std::vector<std::pair<unsigned int, unsigned int>>& contacts);
+
+	// contacts and their impact times are sorted in place together, call before the positions are updated
+	void solve(ParticleStore& particles, std::vector<std::pair<unsigned int, unsigned int>>& contacts, std::vector<float>& impactTimes);
+
+private:
+	static const unsigned int colorCount = 64; // colors that fit a particle's mask, contacts left over are solved one by one
+
+	// contacts are sorted, impactTimes is null or holds one time per contact
+	void solveSorted(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, const std::vector<float>* impactTimes);
+	void solveContact(ParticleStore& particles, unsigned int i, unsigned int j, float impactTime) const;
+
+	std::vector<uint32_t> contactOrder;
+	std::vector<std::pair<unsigned int, unsigned int>> sortedContacts;
+	std::vector<float> sortedImpactTimes;
+
+	std::vector<uint64_t> particleColors; // colors already taken by each particle's contacts
+	std::vector<unsigned char> contactColors;
+	std::vector<uint32_t> colorStarts;    // first contact of each color in colorContacts, colorCount + 2 entries
+	std::vector<uint32_t> colorEnds;
+	std::vector<uint32_t> colorContacts;  // contacts grouped by color, in contact order within each color
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <algorithm>
+#include "FragmentGenerator.h"
+#include "RandomStream.h"
+
+namespace {
+	const size_t chunkSize = 256;
+	const float pi = 3.14159265358979f;
+
+	// centred between min and max with a third of the range as the deviation
+	inline float shape(float normal, float min, float max) {
+		return (min + max) * 0.5f + normal * (max - min) * (1.0f / 3.0f);
+	}
+
+	// one array of the chunk drawn from a normal column
+	void fillColumn(float* values, const float* normals, size_t count, float min, float max) {
+		for (size_t n = 0; n < count; n++) {
+			values[n] = shape(normals[n], min, max);
+		}
+	}
+}
+
+void generateFragments(ParticleStore& fragments, size_t begin, size_t end, const FragmentDistribution& distribution,
+	float modelRadius, float density, uint16_t parent, uint64_t seed) {
+	uint32_t key0 = (uint32_t)seed;
+	uint32_t key1 = (uint32_t)(seed >> 32);
+	float smallestScale = 0.5f * std::max(distribution.scaleMin, 0.01f * distribution.scaleMax);
+
+	// eight normals per fragment, one column per value, so every loop below runs down contiguous memory
+	alignas(64) uint32_t words[8][chunkSize];
+	alignas(64) float normals[8][chunkSize];
+
+	for (size_t start = begin; start < end; start += chunkSize) {
+		size_t count = std::min(chunkSize, end - start);
+
+		// the first two blocks of each fragment's stream, the same words a RandomStream of it would give
+		for (uint32_t block = 0; block < 2; block++) {
+			for (size_t n = 0; n < count; n++) {
+				uint64_t stream = start + n;
+				uint32_t counter[4] = { block, 0, (uint32_t)stream, (uint32_t)(stream >> 32) };
+				uint32_t result[4];
+				philox(counter, key0, key1, result);
+
+				words[4 * block][n] = result[0];
+				words[4 * block + 1][n] = result[1];
+				words[4 * block + 2][n] = result[2];
+				words[4 * block + 3][n] = result[3];
+			}
+		}
+
+		// Box-Muller turns every two uniform columns into two normal columns
+		for (int pair = 0; pair < 4; pair++) {
+			for (size_t n = 0; n < count; n++) {
+				float radius = std::sqrt(-2.0f * std::log(1.0f - randomUnit(words[2 * pair][n])));
+				float angle = 6.28318531f * randomUnit(words[2 * pair + 1][n]);
+				normals[2 * pair][n] = radius * std::cos(angle);
+				normals[2 * pair + 1][n] = radius * std::sin(angle);
+			}
+		}
+
+		float* scale = fragments.scale.data() + start;
+		float* radius = fragments.radius.data() + start;
+		float* mass = fragments.mass.data() + start;
+
+		// the normal's tail reaches below zero scale, those fragments are drawn at the smallest scale instead so every
+		// fragment has a size and a mass and is rendered at the scale it collides with
+		fillColumn(scale, normals[0], count, distribution.scaleMin, distribution.scaleMax);
+		for (size_t n = 0; n < count; n++) {
+			scale[n] = std::max(scale[n], smallestScale);
+			radius[n] = modelRadius * scale[n];
+			mass[n] = density * (4.0f / 3.0f) * pi * radius[n] * radius[n] * radius[n];
+		}
+
+		fillColumn(fragments.x.data() + start, normals[1], count, distribution.positionMin.x, distribution.positionMax.x);
+		fillColumn(fragments.y.data() + start, normals[2], count, distribution.positionMin.y, distribution.positionMax.y);
+		fillColumn(fragments.z.data() + start, normals[3], count, distribution.positionMin.z, distribution.positionMax.z);
+		fillColumn(fragments.vx.data() + start, normals[4], count, distribution.velocityMin.x, distribution.velocityMax.x);
+		fillColumn(fragments.vy.data() + start, normals[5], count, distribution.velocityMin.y, distribution.velocityMax.y);
+		fillColumn(fragments.vz.data() + start, normals[6], count, distribution.velocityMin.z, distribution.velocityMax.z);
+
+		// new fragments have not moved yet
+		std::copy(fragments.x.data() + start, fragments.x.data() + start + count, fragments.previousX.data() + start);
+		std::copy(fragments.y.data() + start, fragments.y.data() + start + count, fragments.previousY.data() + start);
+		std::copy(fragments.z.data() + start, fragments.z.data() + start + count, fragments.previousZ.data() + start);
+
+		std::fill(fragments.parent.data() + start, fragments.parent.data() + start + count, parent);
+		std::fill(fragments.asleep.data() + start, fragments.asleep.data() + start + count, (unsigned char)0);
+		std::fill(fragments.depth.data() + start, fragments.depth.data() + start + count, (unsigned char)0);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef FRAGMENT_GENERATOR_H
+#define FRAGMENT_GENERATOR_H
+
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Ranges the fragments of one asteroid are drawn from. Every value is normal, centred between the
+/// ends of its range with a third of the range as the deviation, so a few fragments land outside it.
+/// Scales are raised to at least half of scaleMin, or a two hundredth of scaleMax when that is larger, so the
+/// tail below zero does not give fragments without a size.
+/// </summary>
+struct FragmentDistribution {
+	float scaleMin = 0.0f, scaleMax = 0.0f;
+	cy::Vec3f positionMin = cy::Vec3f(0.0f, 0.0f, 0.0f), positionMax = cy::Vec3f(0.0f, 0.0f, 0.0f);
+	cy::Vec3f velocityMin = cy::Vec3f(0.0f, 0.0f, 0.0f), velocityMax = cy::Vec3f(0.0f, 0.0f, 0.0f);
+};
+
+// fill particles [begin, end) with fragments drawn from the distribution, a chunk at a time with one loop per
+// array, radii come from the bounding radius of the model at scale 1 and masses from spheres of the given
+// density, fragment i always draws from the seed's stream i so the result does not depend on the chunks
+void generateFragments(ParticleStore& fragments, size_t begin, size_t end, const FragmentDistribution& distribution,
+	float modelRadius, float density, uint16_t parent, uint64_t seed);
+
+#endif
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include "FragmentSpawner.h"
+#include "Parallel.h"
+
+size_t FragmentSpawner::prepare(size_t count, const GenerateFunction& generate) {
+	size_t first = prepared.add(count);
+
+	parallelFor((unsigned int)count, [&](unsigned int begin, unsigned int end) {
+		generate(prepared, first + begin, first + end);
+	});
+
+	return first;
+}
+
+void FragmentSpawner::start(size_t begin, size_t end, const cy::Vec3f& offset) {
+	if (begin < end) {
+		queue.push_back({ begin, end, offset });
+	}
+}
+
+size_t FragmentSpawner::spawn(ParticleStore& particles, size_t batchSize) {
+	size_t count = 0;
+	for (size_t r = queueFront; r < queue.size(); r++) {
+		count += queue[r].end - queue[r].begin;
+	}
+	if (batchSize > 0) {
+		count = std::min(count, batchSize);
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	size_t first = particles.add(count);
+	size_t moved = 0;
+
+	while (moved < count) {
+		SpawnRange& range = queue[queueFront];
+		size_t rangeCount = std::min(range.end - range.begin, count - moved);
+		size_t source = range.begin;
+		size_t target = first + moved;
+		cy::Vec3f offset = range.offset;
+
+		parallelFor((unsigned int)rangeCount, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = begin; n < end; n++) {
+				size_t from = source + n;
+				size_t to = target + n;
+
+				particles.x[to] = prepared.x[from] + offset.x;
+				particles.y[to] = prepared.y[from] + offset.y;
+				particles.z[to] = prepared.z[from] + offset.z;
+				particles.previousX[to] = prepared.previousX[from] + offset.x;
+				particles.previousY[to] = prepared.previousY[from] + offset.y;
+				particles.previousZ[to] = prepared.previousZ[from] + offset.z;
+				particles.vx[to] = prepared.vx[from];
+				particles.vy[to] = prepared.vy[from];
+				particles.vz[to] = prepared.vz[from];
+				particles.radius[to] = prepared.radius[from];
+				particles.mass[to] = prepared.mass[from];
+				particles.scale[to] = prepared.scale[from];
+				particles.parent[to] = prepared.parent[from];
+				particles.asleep[to] = prepared.asleep[from];
+				particles.depth[to] = prepared.depth[from];
+			}
+		});
+
+		moved += rangeCount;
+		range.begin += rangeCount;
+		if (range.begin == range.end) {
+			queueFront++;
+		}
+	}
+
+	// the queue only grows until everything queued has spawned
+	if (queueFront == queue.size()) {
+		queue.clear();
+		queueFront = 0;
+	}
+
+	return count;
+}
+
+void FragmentSpawner::clear() {
+	prepared.clear();
+	queue.clear();
+	queueFront = 0;
+}
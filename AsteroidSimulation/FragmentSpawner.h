@@ -0,0 +1,48 @@
+#ifndef FRAGMENT_SPAWNER_H
+#define FRAGMENT_SPAWNER_H
+
+#include <vector>
+#include <functional>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Generates the fragments of explosions ahead of the impacts, in parallel chunks, and later moves them
+/// into the simulation's particles. Fragments are prepared around the origin and moved to where the
+/// explosion happens as they are spawned. The move is a parallel copy, either all at once on the impact
+/// step or a batch per step so a very large explosion streams in over a few steps.
+/// </summary>
+class FragmentSpawner {
+public:
+	// must fill in fragments [begin, end) of the given store, called from several threads at once
+	typedef std::function<void(ParticleStore& fragments, size_t begin, size_t end)> GenerateFunction;
+
+	// generate count more fragments to spawn later, returns the index of the first of them among the prepared fragments
+	size_t prepare(size_t count, const GenerateFunction& generate);
+
+	// queue the prepared fragments [begin, end) to be spawned, moved by offset
+	void start(size_t begin, size_t end, const cy::Vec3f& offset);
+
+	// move up to batchSize queued fragments into particles, in the order they were queued, 0 moves all of them,
+	// returns the number moved
+	size_t spawn(ParticleStore& particles, size_t batchSize);
+
+	// drop the prepared fragments and the queue
+	void clear();
+
+	// the prepared fragments, to adjust them before they are spawned
+	ParticleStore& getPrepared() { return prepared; }
+
+private:
+	struct SpawnRange {
+		size_t begin, end;
+		cy::Vec3f offset;
+	};
+
+	ParticleStore prepared;
+
+	std::vector<SpawnRange> queue;
+	size_t queueFront = 0;
+};
+
+#endif
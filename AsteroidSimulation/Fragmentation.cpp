@@ -0,0 +1,191 @@
+#include <cmath>
+#include <algorithm>
+#include "cyMatrix.h"
+#include "Fragmentation.h"
+#include "Parallel.h"
+
+void Fragmentation::measureImpacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts) {
+	// only the particles of an unsplit measurement can still hold energy
+	for (uint32_t i : impactedParticles) {
+		if (i < impactEnergies.size()) {
+			impactEnergies[i] = 0.0f;
+		}
+	}
+	impactedParticles.clear();
+	impactEnergies.resize(particles.size(), 0.0f);
+
+	contactEnergies.resize(contacts.size());
+	parallelFor((unsigned int)contacts.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; c++) {
+			unsigned int i = contacts[c].first;
+			unsigned int j = contacts[c].second;
+
+			cy::Vec3f normal = particles.getPosition(j) - particles.getPosition(i);
+			float distance = normal.Length();
+			float approach = (particles.getVelocity(j) - particles.getVelocity(i)).Dot(normal);
+			float totalMass = particles.mass[i] + particles.mass[j];
+
+			// separating contacts do not hit anything
+			if (distance <= 0.0f || approach >= 0.0f || totalMass <= 0.0f) {
+				contactEnergies[c] = 0.0f;
+				continue;
+			}
+
+			float speed = approach / distance;
+			float reducedMass = particles.mass[i] * particles.mass[j] / totalMass;
+			contactEnergies[c] = 0.5f * reducedMass * speed * speed;
+		}
+	});
+
+	// summed in contact order, so the totals are the same for any thread count
+	for (size_t c = 0; c < contacts.size(); c++) {
+		if (contactEnergies[c] <= 0.0f) {
+			continue;
+		}
+
+		unsigned int ends[2] = { contacts[c].first, contacts[c].second };
+		for (unsigned int i : ends) {
+			if (impactEnergies[i] == 0.0f) {
+				impactedParticles.push_back(i);
+			}
+			impactEnergies[i] += contactEnergies[c] / particles.mass[i];
+		}
+	}
+}
+
+void Fragmentation::excludeParticles(const std::vector<uint32_t>& particles) {
+	for (uint32_t i : particles) {
+		if (i < impactEnergies.size()) {
+			impactEnergies[i] = 0.0f;
+		}
+	}
+}
+
+size_t Fragmentation::split(ParticleStore& particles, float energyThreshold, unsigned int childCount, unsigned int maxDepth) {
+	splitParticles.clear();
+
+	if (childCount >= 2) {
+		buildChildDirections(childCount);
+
+		// lowest index first, so the same particles split whatever order the contacts came in
+		std::sort(impactedParticles.begin(), impactedParticles.end());
+
+		// every split adds all but its first child behind the last particle, as long as the reserved memory lasts
+		size_t first = particles.size();
+		size_t added = 0;
+		for (uint32_t i : impactedParticles) {
+			if (i >= first || impactEnergies[i] <= energyThreshold || particles.depth[i] >= maxDepth) {
+				continue;
+			}
+			if (first + added + childCount - 1 > particles.getCapacity()) {
+				break;
+			}
+
+			splitParticles.push_back(i);
+			added += childCount - 1;
+		}
+
+		if (added > 0) {
+			particles.add(added);
+		}
+
+		float childShare = 1.0f / (float)childCount;
+		float childSize = std::cbrt(childShare);
+
+		parallelFor((unsigned int)splitParticles.size(), [&](unsigned int begin, unsigned int end) {
+			for (unsigned int n = begin; n < end; n++) {
+				uint32_t i = splitParticles[n];
+
+				cy::Vec3f position = particles.getPosition(i);
+				cy::Vec3f previousPosition(particles.previousX[i], particles.previousY[i], particles.previousZ[i]);
+				cy::Vec3f velocity = particles.getVelocity(i);
+				float radius = particles.radius[i];
+				float mass = particles.mass[i];
+				float scale = particles.scale[i];
+				uint16_t parent = particles.parent[i];
+				unsigned char depth = particles.depth[i];
+
+				float childRadius = radius * childSize;
+
+				// the threshold's worth of energy went into breaking the particle, the rest sends the children apart
+				float spreadSpeed = std::sqrt(2.0f * (impactEnergies[i] - energyThreshold));
+
+				// turn every split differently so the children of neighbouring splits do not line up
+				cy::Matrix3f turn = cy::Matrix3f::RotationXYZ((float)i * 2.39996f, (float)i * 1.61803f, 0.0f);
+
+				for (unsigned int c = 0; c < childCount; c++) {
+					size_t child = c == 0 ? i : first + (size_t)n * (childCount - 1) + c - 1;
+
+					cy::Vec3f direction = turn * childDirections[c];
+					cy::Vec3f offset = direction * (childSpacing * childRadius);
+
+					particles.x[child] = position.x + offset.x;
+					particles.y[child] = position.y + offset.y;
+					particles.z[child] = position.z + offset.z;
+					particles.previousX[child] = previousPosition.x + offset.x;
+					particles.previousY[child] = previousPosition.y + offset.y;
+					particles.previousZ[child] = previousPosition.z + offset.z;
+					particles.setVelocity(child, velocity + direction * spreadSpeed);
+					particles.radius[child] = childRadius;
+					particles.mass[child] = mass * childShare;
+					particles.scale[child] = scale * childSize;
+					particles.parent[child] = parent;
+					particles.asleep[child] = 0;
+					particles.depth[child] = depth + 1;
+				}
+			}
+		});
+	}
+
+	// the measured energy is used up, split or not
+	for (uint32_t i : impactedParticles) {
+		if (i < impactEnergies.size()) {
+			impactEnergies[i] = 0.0f;
+		}
+	}
+	impactedParticles.clear();
+
+	return splitParticles.size();
+}
+
+void Fragmentation::buildChildDirections(unsigned int childCount) {
+	if (childDirections.size() == childCount) {
+		return;
+	}
+
+	// evenly spread over the sphere
+	childDirections.resize(childCount);
+	cy::Vec3f sum(0.0f, 0.0f, 0.0f);
+	for (unsigned int c = 0; c < childCount; c++) {
+		float z = 1.0f - (2.0f * c + 1.0f) / (float)childCount;
+		float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		float angle = (float)c * 2.39996f;
+		childDirections[c] = cy::Vec3f(ring * std::cos(angle), ring * std::sin(angle), z);
+		sum += childDirections[c];
+	}
+
+	// centre them so the children keep the particle's momentum, then scale them to an average squared length of one
+	// so the spread speed carries exactly the leftover energy
+	float lengthSquared = 0.0f;
+	for (cy::Vec3f& direction : childDirections) {
+		direction -= sum / (float)childCount;
+		lengthSquared += direction.Dot(direction);
+	}
+	float normalize = std::sqrt((float)childCount / lengthSquared);
+	for (cy::Vec3f& direction : childDirections) {
+		direction *= normalize;
+	}
+
+	// the closest pair of directions decides how far out the children go so that none overlaps another
+	float closestSquared = 0.0f;
+	for (unsigned int c = 0; c < childCount; c++) {
+		for (unsigned int d = c + 1; d < childCount; d++) {
+			cy::Vec3f offset = childDirections[d] - childDirections[c];
+			float distanceSquared = offset.Dot(offset);
+			if (closestSquared == 0.0f || distanceSquared < closestSquared) {
+				closestSquared = distanceSquared;
+			}
+		}
+	}
+	childSpacing = 2.0f / std::sqrt(closestSquared);
+}
@@ -0,0 +1,42 @@
+#ifndef FRAGMENTATION_H
+#define FRAGMENTATION_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Breaks fragments that are hit hard into smaller fragments. The energy every particle takes from its
+/// approaching contacts is measured before the contacts are resolved, and each particle that took more than
+/// the threshold per unit of its mass splits into children of equal mass spreading out with the energy left
+/// over. The children are placed around the particle's center just touching each other, so the contacts do not
+/// push them apart. The particle itself becomes the first child and the rest are added behind the last particle, so a
+/// store reserved up front takes a whole cascade without allocating. Splits stop once the store is full.
+/// </summary>
+class Fragmentation {
+public:
+	// add up the impact energy of every particle in the contacts, call before the contacts are solved
+	void measureImpacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts);
+
+	// keep the given particles whole at the next split, whatever they took from their impacts
+	void excludeParticles(const std::vector<uint32_t>& particles);
+
+	// split every measured particle that took more than energyThreshold per unit mass into childCount children,
+	// particles whose ancestors already broke up maxDepth times stay whole, returns the number of splits
+	size_t split(ParticleStore& particles, float energyThreshold, unsigned int childCount, unsigned int maxDepth);
+
+private:
+	void buildChildDirections(unsigned int childCount);
+
+	std::vector<float> contactEnergies;     // energy of the approach along the normal of every contact
+	std::vector<float> impactEnergies;      // of every particle per unit mass, zero for particles not in impactedParticles
+	std::vector<uint32_t> impactedParticles;
+
+	std::vector<uint32_t> splitParticles;
+	std::vector<cy::Vec3f> childDirections; // one per child, they add up to zero so splits keep momentum
+	float childSpacing = 0.0f;              // offset along the directions, in child radii, that puts the closest children just touching
+};
+
+#endif
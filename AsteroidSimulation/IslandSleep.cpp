@@ -0,0 +1,232 @@
+#include <limits>
+#include <algorithm>
+#include "IslandSleep.h"
+#include "Parallel.h"
+
+namespace {
+	const uint32_t noParticle = 0xffffffffu;
+}
+
+void IslandSleep::wakeTouched(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& pairs) {
+	for (const std::pair<unsigned int, unsigned int>& pair : pairs) {
+		if (particles.asleep[pair.first] != particles.asleep[pair.second]) {
+			wakeIsland(particles, particles.asleep[pair.first] ? pair.first : pair.second);
+		}
+	}
+}
+
+void IslandSleep::update(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, const std::vector<cy::Vec3f>& accelerations,
+	float timeStep, float sleepSpeed, unsigned int sleepSteps) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	slowSteps.resize(particleCount, 0);
+	nextInIsland.resize(particleCount, noParticle);
+	restSpeeds.resize(particleCount, 0.0f);
+	sleepVelocity.resize(particleCount, cy::Vec3f(0.0f, 0.0f, 0.0f));
+	islandParents.resize(particleCount);
+	islandSlowSteps.resize(particleCount);
+	islandRestSpeeds.resize(particleCount);
+	islandLast.resize(particleCount);
+
+	pullSleepingIslands(particles, accelerations, timeStep);
+
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			islandParents[i] = i;
+			islandSlowSteps[i] = 0xffff;
+			islandRestSpeeds[i] = std::numeric_limits<float>::max();
+			islandLast[i] = noParticle;
+		}
+	});
+
+	// particles in contact share an island
+	for (const std::pair<unsigned int, unsigned int>& contact : contacts) {
+		uint32_t first = findRoot(contact.first);
+		uint32_t second = findRoot(contact.second);
+		if (first != second) {
+			islandParents[std::max(first, second)] = std::min(first, second);
+		}
+	}
+
+	// an island rests when it moves less than a fraction of its smallest particle per step, point every awake
+	// particle straight at its root so the roots can be looked up on all cores
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!particles.asleep[i]) {
+			uint32_t root = findRoot(i);
+			islandParents[i] = root;
+			islandRestSpeeds[root] = std::min(islandRestSpeeds[root], sleepSpeed * particles.radius[i]);
+		}
+	}
+
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			if (!particles.asleep[i]) {
+				float restSpeed = islandRestSpeeds[islandParents[i]];
+				float speedSquared = particles.getVelocity(i).Dot(particles.getVelocity(i));
+				slowSteps[i] = speedSquared < restSpeed * restSpeed ? (uint16_t)std::min((unsigned int)slowSteps[i] + 1, 0xffffu) : 0;
+			}
+		}
+	});
+
+	// an island has been slow for as long as its fastest particle
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!particles.asleep[i]) {
+			uint32_t root = islandParents[i];
+			islandSlowSteps[root] = std::min(islandSlowSteps[root], slowSteps[i]);
+		}
+	}
+
+	// link the particles of every island that falls asleep into a ring, in index order
+	awakeCount = 0;
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (particles.asleep[i]) {
+			continue;
+		}
+
+		uint32_t root = islandParents[i];
+		if (islandSlowSteps[root] < sleepSteps) {
+			awakeCount++;
+			continue;
+		}
+
+		particles.asleep[i] = 1;
+		particles.setVelocity(i, cy::Vec3f(0.0f, 0.0f, 0.0f));
+		restSpeeds[i] = islandRestSpeeds[root];
+		sleepVelocity[i] = cy::Vec3f(0.0f, 0.0f, 0.0f);
+
+		if (islandLast[root] == noParticle) {
+			nextInIsland[i] = i;
+		}
+		else {
+			nextInIsland[i] = nextInIsland[islandLast[root]];
+			nextInIsland[islandLast[root]] = i;
+		}
+		islandLast[root] = i;
+	}
+}
+
+void IslandSleep::pullSleepingIslands(ParticleStore& particles, const std::vector<cy::Vec3f>& accelerations, float timeStep) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	pulled.assign(particleCount, 0);
+
+	// in index order, every ring is handled once from its lowest particle
+	for (unsigned int i = 0; i < particleCount; i++) {
+		if (!particles.asleep[i] || pulled[i]) {
+			continue;
+		}
+
+		// the pulls between the island's own particles cancel in the mass weighted sum, what is left moves the island as a whole
+		cy::Vec3f force(0.0f, 0.0f, 0.0f);
+		float mass = 0.0f;
+		uint32_t particle = i;
+		do {
+			if (particle < accelerations.size()) {
+				force += accelerations[particle] * particles.mass[particle];
+			}
+			mass += particles.mass[particle];
+			pulled[particle] = 1;
+			particle = nextInIsland[particle];
+		} while (particle != i);
+
+		cy::Vec3f velocity = sleepVelocity[i];
+		if (mass > 0.0f) {
+			velocity += force * (timeStep / mass);
+		}
+
+		bool wake = velocity.Dot(velocity) > restSpeeds[i] * restSpeeds[i];
+		if (wake) {
+			wakeIsland(particles, i);
+		}
+
+		// a woken island sets off with the velocity it would have picked up
+		particle = i;
+		do {
+			sleepVelocity[particle] = velocity;
+			if (wake) {
+				particles.setVelocity(particle, velocity);
+			}
+			particle = nextInIsland[particle];
+		} while (particle != i);
+	}
+}
+
+void IslandSleep::wakeAll(ParticleStore& particles) {
+	for (size_t i = 0; i < particles.size(); i++) {
+		particles.asleep[i] = 0;
+	}
+	std::fill(slowSteps.begin(), slowSteps.end(), 0);
+	awakeCount = particles.size();
+}
+
+void IslandSleep::clear() {
+	slowSteps.clear();
+	nextInIsland.clear();
+	restSpeeds.clear();
+	sleepVelocity.clear();
+	awakeCount = 0;
+}
+
+void IslandSleep::removeParticle(const ParticleStore& particles, uint32_t i) {
+	uint32_t last = (uint32_t)particles.size() - 1;
+	if (i >= slowSteps.size()) {
+		return; // added since the last update, like every particle after it
+	}
+
+	// take i out of its sleeping ring
+	if (particles.asleep[i] && nextInIsland[i] != i) {
+		nextInIsland[findPrevious(i)] = nextInIsland[i];
+	}
+
+	if (last >= slowSteps.size()) {
+		slowSteps[i] = 0; // the last particle is new and has no history
+		return;
+	}
+
+	// the last particle moves to i, and its ring neighbour has to point there
+	if (i != last) {
+		slowSteps[i] = slowSteps[last];
+		restSpeeds[i] = restSpeeds[last];
+		sleepVelocity[i] = sleepVelocity[last];
+		if (particles.asleep[last]) {
+			uint32_t next = nextInIsland[last];
+			if (next == last) {
+				nextInIsland[i] = i;
+			}
+			else {
+				nextInIsland[findPrevious(last)] = i;
+				nextInIsland[i] = next;
+			}
+		}
+	}
+
+	slowSteps.pop_back();
+	nextInIsland.pop_back();
+	restSpeeds.pop_back();
+	sleepVelocity.pop_back();
+}
+
+uint32_t IslandSleep::findPrevious(uint32_t i) const {
+	uint32_t previous = i;
+	while (nextInIsland[previous] != i) {
+		previous = nextInIsland[previous];
+	}
+	return previous;
+}
+
+uint32_t IslandSleep::findRoot(uint32_t i) {
+	// path halving keeps the trees flat
+	while (islandParents[i] != i) {
+		islandParents[i] = islandParents[islandParents[i]];
+		i = islandParents[i];
+	}
+	return i;
+}
+
+void IslandSleep::wakeIsland(ParticleStore& particles, uint32_t i) {
+	uint32_t particle = i;
+	do {
+		particles.asleep[particle] = 0;
+		slowSteps[particle] = 0;
+		awakeCount++;
+		particle = nextInIsland[particle];
+	} while (particle != i);
+}
@@ -0,0 +1,62 @@
+#ifndef ISLAND_SLEEP_H
+#define ISLAND_SLEEP_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Puts resting groups of particles to sleep. Every step the contacts join particles into islands with
+/// union-find, and an island falls asleep once all of its particles have moved slower than the island's
+/// own rest speed for a number of steps, so islands of small fragments need to be slower than islands of
+/// large ones. A lone particle is an island of its own. Sleepers are left out of collision tests and
+/// integration, a sleeping island wakes as a whole as soon as an awake particle's bounds reach one of its
+/// particles, or once the pull on it would have carried it faster than its rest speed.
+/// </summary>
+class IslandSleep {
+public:
+	// wake the islands of sleepers whose bounds overlap an awake particle in one of the pairs
+	void wakeTouched(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& pairs);
+
+	// add the pull of the last timeStep to every sleeping island and wake the ones it would have moved too fast, then
+	// join the particles in contact into islands and put every island whose particles all moved slower than sleepSpeed
+	// of the island's smallest radius for sleepSteps steps to sleep, accelerations are per particle and may be
+	// empty or miss the newest particles, which then feel no pull, contacts must be between awake particles
+	void update(ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& contacts, const std::vector<cy::Vec3f>& accelerations,
+		float timeStep, float sleepSpeed, unsigned int sleepSteps);
+
+	// wake every particle
+	void wakeAll(ParticleStore& particles);
+
+	// forget every particle's history, call when the particles are replaced
+	void clear();
+
+	// remove particle i, the store's last particle takes its place, call right before ParticleStore::remove
+	void removeParticle(const ParticleStore& particles, uint32_t i);
+
+	// particles left awake by the last update
+	size_t getAwakeCount() const { return awakeCount; }
+
+private:
+	uint32_t findRoot(uint32_t i);
+	uint32_t findPrevious(uint32_t i) const;
+	void wakeIsland(ParticleStore& particles, uint32_t i);
+	void pullSleepingIslands(ParticleStore& particles, const std::vector<cy::Vec3f>& accelerations, float timeStep);
+
+	std::vector<uint16_t> slowSteps;     // steps each particle has stayed slow
+	std::vector<uint32_t> islandParents; // union-find forest, rebuilt every update
+	std::vector<uint16_t> islandSlowSteps;
+	std::vector<float> islandRestSpeeds;
+	std::vector<uint32_t> islandLast;
+	std::vector<uint32_t> nextInIsland;  // sleeping islands are kept as rings so one member can wake the rest
+
+	std::vector<float> restSpeeds;        // of each sleeping particle's island
+	std::vector<cy::Vec3f> sleepVelocity; // the pull on each sleeping particle's island added up since it fell asleep
+	std::vector<unsigned char> pulled;
+
+	size_t awakeCount = 0;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include "LinearBVH.h"
+#include "Parallel.h"
+#include "MortonCode.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	const uint32_t noParent = 0xffffffffu;
+
+	int countLeadingZeros(uint32_t value) {
+		if (value == 0) {
+			return 32;
+		}
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return 31 - (int)index;
+#else
+		return __builtin_clz(value);
+#endif
+	}
+
+	cy::Vec3f minimum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+	}
+
+	cy::Vec3f maximum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+	}
+
+	bool overlaps(const cy::Vec3f& minA, const cy::Vec3f& maxA, const cy::Vec3f& minB, const cy::Vec3f& maxB) {
+		return minA.x <= maxB.x && minB.x <= maxA.x &&
+			minA.y <= maxB.y && minB.y <= maxA.y &&
+			minA.z <= maxB.z && minB.z <= maxA.z;
+	}
+}
+
+void LinearBVH::build(const ParticleStore& particles, float sweepTime) {
+	leafCount = (unsigned int)particles.size();
+
+	boundsMin.resize(leafCount);
+	boundsMax.resize(leafCount);
+	sleeping.resize(leafCount);
+	parallelFor(leafCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			particles.getBounds(i, sweepTime, boundsMin[i], boundsMax[i]);
+			sleeping[i] = particles.asleep[i];
+		}
+	});
+
+	if (leafCount < 2) {
+		nodes.clear();
+		return;
+	}
+
+	computeMortonCodes(particles);
+	sortMortonCodes();
+
+	nodes.resize(leafCount - 1);
+	leafParents.resize(leafCount);
+	nodeParents.resize(leafCount - 1);
+	if (visitCapacity < leafCount - 1) {
+		visitCapacity = leafCount - 1;
+		visits.reset(new std::atomic<uint32_t>[visitCapacity]);
+	}
+
+	// every internal node finds its own children from the sorted codes
+	nodeParents[0] = noParent;
+	parallelFor(leafCount - 1, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			visits[i].store(0, std::memory_order_relaxed);
+			buildNode(i);
+		}
+	});
+
+	// fit the boxes bottom up, the second child to reach a node finishes it
+	parallelFor(leafCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int leaf = begin; leaf < end; leaf++) {
+			refitFromLeaf(leaf);
+		}
+	});
+}
+
+void LinearBVH::findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const {
+	pairs.clear();
+	if (leafCount < 2) {
+		return;
+	}
+
+	unsigned int chunkCount = getWorkerCount();
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> chunkPairs(chunkCount);
+
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		std::vector<uint32_t> stack;
+
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)leafCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)leafCount * (chunk + 1) / chunkCount);
+
+			for (unsigned int leaf = begin; leaf < end; leaf++) {
+				unsigned int particle = sortedParticles[leaf];
+				if (sleeping[particle]) {
+					continue;
+				}
+				const cy::Vec3f& queryMin = boundsMin[particle];
+				const cy::Vec3f& queryMax = boundsMax[particle];
+
+				// only look at awake leaves after this one so every pair is found once, sleepers do not search
+				// so their pairs are found from the awake side wherever they are
+				stack.clear();
+				stack.push_back(0);
+				while (!stack.empty()) {
+					const Node& node = nodes[stack.back()];
+					stack.pop_back();
+
+					uint32_t children[2] = { node.left, node.right };
+					for (uint32_t child : children) {
+						if (child & leafFlag) {
+							uint32_t otherLeaf = child & ~leafFlag;
+							unsigned int other = sortedParticles[otherLeaf];
+							if ((otherLeaf > leaf || sleeping[other]) && overlaps(queryMin, queryMax, boundsMin[other], boundsMax[other])) {
+								chunkPairs[chunk].push_back(std::make_pair(std::min(particle, other), std::max(particle, other)));
+							}
+						}
+						else {
+							const Node& childNode = nodes[child];
+							if ((childNode.lastLeaf > leaf || childNode.sleepingLeaves > 0) && overlaps(queryMin, queryMax, childNode.boundsMin, childNode.boundsMax)) {
+								stack.push_back(child);
+							}
+						}
+					}
+				}
+			}
+		}
+	});
+
+	for (const std::vector<std::pair<unsigned int, unsigned int>>& chunk : chunkPairs) {
+		pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+	}
+}
+
+void LinearBVH::computeMortonCodes(const ParticleStore& particles) {
+	unsigned int chunkCount = getWorkerCount();
+	std::vector<cy::Vec3f> chunkMin(chunkCount, particles.getPosition(0));
+	std::vector<cy::Vec3f> chunkMax(chunkCount, particles.getPosition(0));
+
+	// bounds of the particle centers
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)leafCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)leafCount * (chunk + 1) / chunkCount);
+			for (unsigned int i = begin; i < end; i++) {
+				chunkMin[chunk] = minimum(chunkMin[chunk], particles.getPosition(i));
+				chunkMax[chunk] = maximum(chunkMax[chunk], particles.getPosition(i));
+			}
+		}
+	});
+
+	cy::Vec3f sceneMin = chunkMin[0];
+	cy::Vec3f sceneMax = chunkMax[0];
+	for (unsigned int chunk = 1; chunk < chunkCount; chunk++) {
+		sceneMin = minimum(sceneMin, chunkMin[chunk]);
+		sceneMax = maximum(sceneMax, chunkMax[chunk]);
+	}
+
+	cy::Vec3f extent = sceneMax - sceneMin;
+	float scale = 1023.0f / std::max(extent.Max(), 1e-6f);
+
+	mortonCodes.resize(leafCount);
+	sortedParticles.resize(leafCount);
+	parallelFor(leafCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			mortonCodes[i] = getMortonCode(particles.getPosition(i), sceneMin, scale);
+			sortedParticles[i] = i;
+		}
+	});
+}
+
+void LinearBVH::sortMortonCodes() {
+	parallelRadixSort(mortonCodes, sortedParticles, codeScratch, particleScratch, 30);
+}
+
+void LinearBVH::buildNode(unsigned int index) {
+	int i = (int)index;
+
+	// direction of the range this node covers
+	int direction = (commonPrefix(i, i + 1) - commonPrefix(i, i - 1)) >= 0 ? 1 : -1;
+	int minPrefix = commonPrefix(i, i - direction);
+
+	// upper bound for the length of the range
+	int maxLength = 2;
+	while (commonPrefix(i, i + maxLength * direction) > minPrefix) {
+		maxLength *= 2;
+	}
+
+	// binary search for the other end
+	int length = 0;
+	for (int step = maxLength / 2; step >= 1; step /= 2) {
+		if (commonPrefix(i, i + (length + step) * direction) > minPrefix) {
+			length += step;
+		}
+	}
+	int j = i + length * direction;
+
+	// binary search for the split position
+	int nodePrefix = commonPrefix(i, j);
+	int split = 0;
+	int step = length;
+	do {
+		step = (step + 1) / 2;
+		if (commonPrefix(i, i + (split + step) * direction) > nodePrefix) {
+			split += step;
+		}
+	} while (step > 1);
+	int gamma = i + split * direction + std::min(direction, 0);
+
+	Node& node = nodes[index];
+	node.lastLeaf = (uint32_t)std::max(i, j);
+
+	if (std::min(i, j) == gamma) {
+		node.left = (uint32_t)gamma | leafFlag;
+		leafParents[gamma] = index;
+	}
+	else {
+		node.left = (uint32_t)gamma;
+		nodeParents[gamma] = index;
+	}
+
+	if (std::max(i, j) == gamma + 1) {
+		node.right = (uint32_t)(gamma + 1) | leafFlag;
+		leafParents[gamma + 1] = index;
+	}
+	else {
+		node.right = (uint32_t)(gamma + 1);
+		nodeParents[gamma + 1] = index;
+	}
+}
+
+void LinearBVH::refitFromLeaf(unsigned int leaf) {
+	uint32_t index = leafParents[leaf];
+
+	while (index != noParent) {
+		// the first child to arrive leaves the node to its sibling
+		if (visits[index].fetch_add(1, std::memory_order_acq_rel) == 0) {
+			return;
+		}
+
+		Node& node = nodes[index];
+		cy::Vec3f leftMin, leftMax, rightMin, rightMax;
+		uint32_t leftSleeping, rightSleeping;
+
+		if (node.left & leafFlag) {
+			unsigned int particle = sortedParticles[node.left & ~leafFlag];
+			leftMin = boundsMin[particle];
+			leftMax = boundsMax[particle];
+			leftSleeping = sleeping[particle];
+		}
+		else {
+			leftMin = nodes[node.left].boundsMin;
+			leftMax = nodes[node.left].boundsMax;
+			leftSleeping = nodes[node.left].sleepingLeaves;
+		}
+
+		if (node.right & leafFlag) {
+			unsigned int particle = sortedParticles[node.right & ~leafFlag];
+			rightMin = boundsMin[particle];
+			rightMax = boundsMax[particle];
+			rightSleeping = sleeping[particle];
+		}
+		else {
+			rightMin = nodes[node.right].boundsMin;
+			rightMax = nodes[node.right].boundsMax;
+			rightSleeping = nodes[node.right].sleepingLeaves;
+		}
+
+		node.boundsMin = minimum(leftMin, rightMin);
+		node.boundsMax = maximum(leftMax, rightMax);
+		node.sleepingLeaves = leftSleeping + rightSleeping;
+
+		index = nodeParents[index];
+	}
+}
+
+int LinearBVH::commonPrefix(int i, int j) const {
+	if (j < 0 || j >= (int)leafCount) {
+		return -1;
+	}
+
+	uint32_t a = mortonCodes[i];
+	uint32_t b = mortonCodes[j];
+	if (a == b) {
+		// equal codes fall back on the leaf index so every key is unique
+		return 32 + countLeadingZeros((uint32_t)i ^ (uint32_t)j);
+	}
+	return countLeadingZeros(a ^ b);
+}
@@ -0,0 +1,63 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Linear bounding volume hierarchy broad phase. Particles are ordered along a Morton curve and the
+/// tree is built from the sorted codes in parallel every step, so clustered and sparse regions of the
+/// debris cloud both get balanced subtrees. Only awake particles search the tree, and they look at the
+/// sleepers on both sides of them, so two sleepers are never tested against each other.
+/// </summary>
+class LinearBVH {
+public:
+	// rebuild the tree over the boxes the particles sweep in sweepTime
+	void build(const ParticleStore& particles, float sweepTime);
+
+	// collect every pair (i, j) with i < j whose bounding boxes overlap and that are not both asleep
+	void findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const;
+
+private:
+	// child references have the high bit set when they point at a leaf
+	static const uint32_t leafFlag = 0x80000000u;
+
+	struct Node {
+		cy::Vec3f boundsMin;
+		cy::Vec3f boundsMax;
+		uint32_t left;
+		uint32_t right;
+		uint32_t lastLeaf; // highest sorted leaf below this node
+		uint32_t sleepingLeaves;
+	};
+
+	void computeMortonCodes(const ParticleStore& particles);
+	void sortMortonCodes();
+	void buildNode(unsigned int i);
+	void refitFromLeaf(unsigned int leaf);
+	int commonPrefix(int i, int j) const;
+
+	unsigned int leafCount = 0;
+
+	std::vector<cy::Vec3f> boundsMin;
+	std::vector<cy::Vec3f> boundsMax;
+	std::vector<unsigned char> sleeping;
+
+	std::vector<uint32_t> mortonCodes;
+	std::vector<uint32_t> sortedParticles;
+	std::vector<uint32_t> codeScratch;
+	std::vector<uint32_t> particleScratch;
+
+	std::vector<Node> nodes;             // leafCount - 1 internal nodes, the root is node 0
+	std::vector<uint32_t> leafParents;
+	std::vector<uint32_t> nodeParents;
+	std::unique_ptr<std::atomic<uint32_t>[]> visits;
+	unsigned int visitCapacity = 0;
+};
+
+#endif
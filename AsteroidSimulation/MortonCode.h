@@ -0,0 +1,26 @@
+#ifndef MORTON_CODE_H
+#define MORTON_CODE_H
+
+#include <cstdint>
+#include <algorithm>
+#include "cyVector.h"
+
+// spread the low 10 bits out so there are two zero bits between each of them
+inline uint32_t expandMortonBits(uint32_t value) {
+	value = (value * 0x00010001u) & 0xFF0000FFu;
+	value = (value * 0x00000101u) & 0x0F00F00Fu;
+	value = (value * 0x00000011u) & 0xC30C30C3u;
+	value = (value * 0x00000005u) & 0x49249249u;
+	return value;
+}
+
+// 30 bit Morton code of a point, scale maps the bounds to [0, 1023] along every axis
+inline uint32_t getMortonCode(const cy::Vec3f& point, const cy::Vec3f& boundsMin, float scale) {
+	cy::Vec3f cell = (point - boundsMin) * scale;
+	uint32_t x = (uint32_t)std::min(std::max(cell.x, 0.0f), 1023.0f);
+	uint32_t y = (uint32_t)std::min(std::max(cell.y, 0.0f), 1023.0f);
+	uint32_t z = (uint32_t)std::min(std::max(cell.z, 0.0f), 1023.0f);
+	return (expandMortonBits(x) << 2) | (expandMortonBits(y) << 1) | expandMortonBits(z);
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include <cmath>
+#include <algorithm>
+#include "cyCore.h"
+#include "NarrowPhase.h"
+#include "Parallel.h"
+
+// the packed kernels use the intrinsics cyCore.h includes, turning its include off leaves only the scalar one
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) && !defined(CY_NO_INTRIN_H) && !defined(CY_NO_EMMINTRIN_H) && !defined(CY_NO_IMMINTRIN_H)
+#define NARROW_PHASE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit wider instructions inside functions marked for them
+#if defined(NARROW_PHASE_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace {
+	unsigned int testSpheresScalar(const SphereBatch& a, const SphereBatch& b, unsigned int count) {
+		unsigned int hits = 0;
+		_CY_IVDEP_FOR (unsigned int k = 0; k < count; k++) {
+			float dx = b.x[k] - a.x[k];
+			float dy = b.y[k] - a.y[k];
+			float dz = b.z[k] - a.z[k];
+			float radiusSum = a.radius[k] + b.radius[k];
+			if (dx * dx + dy * dy + dz * dz <= radiusSum * radiusSum) {
+				hits |= 1u << k;
+			}
+		}
+		return hits;
+	}
+
+#ifdef NARROW_PHASE_X86
+	unsigned int testSpheresSSE(const SphereBatch& a, const SphereBatch& b, unsigned int count) {
+		unsigned int hits = 0;
+		for (unsigned int k = 0; k < sphereBatchSize; k += 4) {
+			__m128 dx = _mm_sub_ps(_mm_load_ps(b.x + k), _mm_load_ps(a.x + k));
+			__m128 dy = _mm_sub_ps(_mm_load_ps(b.y + k), _mm_load_ps(a.y + k));
+			__m128 dz = _mm_sub_ps(_mm_load_ps(b.z + k), _mm_load_ps(a.z + k));
+			__m128 radiusSum = _mm_add_ps(_mm_load_ps(a.radius + k), _mm_load_ps(b.radius + k));
+
+			__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 hit = _mm_cmple_ps(distanceSquared, _mm_mul_ps(radiusSum, radiusSum));
+			hits |= (unsigned int)_mm_movemask_ps(hit) << k;
+		}
+		return hits & ((count >= 32 ? 0u : (1u << count)) - 1u);
+	}
+
+	TARGET_AVX2 unsigned int testSpheresAVX2(const SphereBatch& a, const SphereBatch& b, unsigned int count) {
+		unsigned int hits = 0;
+		for (unsigned int k = 0; k < sphereBatchSize; k += 8) {
+			__m256 dx = _mm256_sub_ps(_mm256_load_ps(b.x + k), _mm256_load_ps(a.x + k));
+			__m256 dy = _mm256_sub_ps(_mm256_load_ps(b.y + k), _mm256_load_ps(a.y + k));
+			__m256 dz = _mm256_sub_ps(_mm256_load_ps(b.z + k), _mm256_load_ps(a.z + k));
+			__m256 radiusSum = _mm256_add_ps(_mm256_load_ps(a.radius + k), _mm256_load_ps(b.radius + k));
+
+			__m256 distanceSquared = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+			__m256 hit = _mm256_cmp_ps(distanceSquared, _mm256_mul_ps(radiusSum, radiusSum), _CMP_LE_OQ);
+			hits |= (unsigned int)_mm256_movemask_ps(hit) << k;
+		}
+		return hits & ((count >= 32 ? 0u : (1u << count)) - 1u);
+	}
+
+	TARGET_AVX512 unsigned int testSpheresAVX512(const SphereBatch& a, const SphereBatch& b, unsigned int count) {
+		__m512 dx = _mm512_sub_ps(_mm512_load_ps(b.x), _mm512_load_ps(a.x));
+		__m512 dy = _mm512_sub_ps(_mm512_load_ps(b.y), _mm512_load_ps(a.y));
+		__m512 dz = _mm512_sub_ps(_mm512_load_ps(b.z), _mm512_load_ps(a.z));
+		__m512 radiusSum = _mm512_add_ps(_mm512_load_ps(a.radius), _mm512_load_ps(b.radius));
+
+		__m512 distanceSquared = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+		__mmask16 hit = _mm512_cmp_ps_mask(distanceSquared, _mm512_mul_ps(radiusSum, radiusSum), _CMP_LE_OQ);
+		return (unsigned int)hit & ((count >= 32 ? 0u : (1u << count)) - 1u);
+	}
+
+	void cpuid(int leaf, int subleaf, int registers[4]) {
+#ifdef _MSC_VER
+		__cpuidex(registers, leaf, subleaf);
+#else
+		unsigned int a, b, c, d;
+		__asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf));
+		registers[0] = (int)a;
+		registers[1] = (int)b;
+		registers[2] = (int)c;
+		registers[3] = (int)d;
+#endif
+	}
+
+	unsigned long long readExtendedControlRegister() {
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int low, high;
+		__asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((unsigned long long)high << 32) | low;
+#endif
+	}
+#endif
+
+	struct KernelChoice {
+		SphereTestKernel kernel;
+		const char* name;
+	};
+
+	KernelChoice chooseKernel() {
+		KernelChoice choice = { testSpheresScalar, "scalar" };
+
+#ifdef NARROW_PHASE_X86
+		int registers[4];
+		cpuid(0, 0, registers);
+		int maxLeaf = registers[0];
+
+		cpuid(1, 0, registers);
+		bool hasSSE2 = (registers[3] & (1 << 26)) != 0;
+		bool hasFMA = (registers[2] & (1 << 12)) != 0;
+		bool hasOSXSAVE = (registers[2] & (1 << 27)) != 0;
+		bool hasAVX = (registers[2] & (1 << 28)) != 0;
+
+		if (hasSSE2) {
+			choice.kernel = testSpheresSSE;
+			choice.name = "SSE";
+		}
+
+		// the OS also has to save the wider registers on context switches
+		if (!hasOSXSAVE || !hasAVX || maxLeaf < 7) {
+			return choice;
+		}
+		unsigned long long enabledState = readExtendedControlRegister();
+		bool osSavesAVX = (enabledState & 0x6) == 0x6;
+		bool osSavesAVX512 = (enabledState & 0xe6) == 0xe6;
+
+		cpuid(7, 0, registers);
+		bool hasAVX2 = (registers[1] & (1 << 5)) != 0;
+		bool hasAVX512F = (registers[1] & (1 << 16)) != 0;
+
+		if (osSavesAVX && hasAVX2 && hasFMA) {
+			choice.kernel = testSpheresAVX2;
+			choice.name = "AVX2";
+		}
+		if (osSavesAVX512 && hasAVX512F) {
+			choice.kernel = testSpheresAVX512;
+			choice.name = "AVX-512";
+		}
+#endif
+
+		return choice;
+	}
+
+	const KernelChoice& getKernelChoice() {
+		static const KernelChoice choice = chooseKernel();
+		return choice;
+	}
+}
+
+SphereTestKernel getSphereTestKernel() {
+	return getKernelChoice().kernel;
+}
+
+const char* getSphereTestKernelName() {
+	return getKernelChoice().name;
+}
+
+void findContacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& candidates, std::vector<std::pair<unsigned int, unsigned int>>& contacts) {
+	SphereTestKernel testSpheres = getSphereTestKernel();
+
+	unsigned int batchCount = (unsigned int)((candidates.size() + sphereBatchSize - 1) / sphereBatchSize);
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), batchCount));
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> chunkContacts(chunkCount);
+
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		SphereBatch a, b;
+
+		// padding lanes are never reported, but keep them finite
+		for (unsigned int k = 0; k < sphereBatchSize; k++) {
+			a.x[k] = a.y[k] = a.z[k] = a.radius[k] = 0.0f;
+			b.x[k] = b.y[k] = b.z[k] = b.radius[k] = 0.0f;
+		}
+
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			size_t begin = (size_t)((unsigned long long)batchCount * chunk / chunkCount) * sphereBatchSize;
+			size_t end = std::min(candidates.size(), (size_t)((unsigned long long)batchCount * (chunk + 1) / chunkCount) * sphereBatchSize);
+
+			for (size_t first = begin; first < end; first += sphereBatchSize) {
+				unsigned int count = (unsigned int)std::min((size_t)sphereBatchSize, end - first);
+
+				// gather the pairs into lanes
+				for (unsigned int k = 0; k < count; k++) {
+					unsigned int i = candidates[first + k].first;
+					unsigned int j = candidates[first + k].second;
+
+					a.x[k] = particles.x[i];
+					a.y[k] = particles.y[i];
+					a.z[k] = particles.z[i];
+					a.radius[k] = particles.radius[i];
+
+					b.x[k] = particles.x[j];
+					b.y[k] = particles.y[j];
+					b.z[k] = particles.z[j];
+					b.radius[k] = particles.radius[j];
+				}
+
+				unsigned int hits = testSpheres(a, b, count);
+				while (hits != 0) {
+					unsigned int k = 0;
+					while (!(hits & (1u << k))) {
+						k++;
+					}
+					chunkContacts[chunk].push_back(candidates[first + k]);
+					hits &= hits - 1;
+				}
+			}
+		}
+	});
+
+	contacts.clear();
+	for (const std::vector<std::pair<unsigned int, unsigned int>>& chunk : chunkContacts) {
+		contacts.insert(contacts.end(), chunk.begin(), chunk.end());
+	}
+}
+
+void findSweptContacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& candidates, float timeStep, std::vector<std::pair<unsigned int, unsigned int>>& contacts, std::vector<float>& impactTimes) {
+	unsigned int candidateCount = (unsigned int)candidates.size();
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), candidateCount));
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> chunkContacts(chunkCount);
+	std::vector<std::vector<float>> chunkImpactTimes(chunkCount);
+
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)candidateCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)candidateCount * (chunk + 1) / chunkCount);
+
+			for (unsigned int c = begin; c < end; c++) {
+				unsigned int i = candidates[c].first;
+				unsigned int j = candidates[c].second;
+
+				// the spheres touch when |offset + relativeVelocity * t| = radiusSum, a quadratic in t
+				cy::Vec3f offset = particles.getPosition(j) - particles.getPosition(i);
+				cy::Vec3f relativeVelocity = particles.getVelocity(j) - particles.getVelocity(i);
+				float radiusSum = particles.radius[i] + particles.radius[j];
+
+				float gap = offset.Dot(offset) - radiusSum * radiusSum;
+				if (gap <= 0.0f) {
+					chunkContacts[chunk].push_back(candidates[c]);
+					chunkImpactTimes[chunk].push_back(0.0f);
+					continue;
+				}
+
+				// spheres that are apart and not closing in never touch
+				float approach = offset.Dot(relativeVelocity);
+				if (approach >= 0.0f) {
+					continue;
+				}
+
+				float speedSquared = relativeVelocity.Dot(relativeVelocity);
+				float discriminant = approach * approach - speedSquared * gap;
+				if (discriminant < 0.0f) {
+					continue;
+				}
+
+				// the smaller root is the first touch
+				float impactTime = (-approach - std::sqrt(discriminant)) / speedSquared;
+				if (impactTime <= timeStep) {
+					chunkContacts[chunk].push_back(candidates[c]);
+					chunkImpactTimes[chunk].push_back(impactTime);
+				}
+			}
+		}
+	});
+
+	contacts.clear();
+	impactTimes.clear();
+	for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+		contacts.insert(contacts.end(), chunkContacts[chunk].begin(), chunkContacts[chunk].end());
+		impactTimes.insert(impactTimes.end(), chunkImpactTimes[chunk].begin(), chunkImpactTimes[chunk].end());
+	}
+}
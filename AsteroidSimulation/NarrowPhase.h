@@ -0,0 +1,38 @@
+#ifndef NARROW_PHASE_H
+#define NARROW_PHASE_H
+
+#include <vector>
+#include <utility>
+#include "ParticleStore.h"
+
+// number of sphere pairs one kernel call tests
+const unsigned int sphereBatchSize = 16;
+
+/// <summary>
+/// Sphere pairs gathered lane by lane, lane k of a is tested against lane k of b.
+/// Testing one fragment against many others is the same batch with a filled with that fragment.
+/// </summary>
+struct SphereBatch {
+	alignas(64) float x[sphereBatchSize];
+	alignas(64) float y[sphereBatchSize];
+	alignas(64) float z[sphereBatchSize];
+	alignas(64) float radius[sphereBatchSize];
+};
+
+// returns a mask with bit k set when lane k of a overlaps lane k of b, lanes past count are never set
+typedef unsigned int (*SphereTestKernel)(const SphereBatch& a, const SphereBatch& b, unsigned int count);
+
+// kernel for the widest instruction set this CPU supports, picked once at startup
+SphereTestKernel getSphereTestKernel();
+
+// name of the instruction set getSphereTestKernel picked
+const char* getSphereTestKernelName();
+
+// keep the candidate pairs whose spheres actually overlap
+void findContacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& candidates, std::vector<std::pair<unsigned int, unsigned int>>& contacts);
+
+// keep the candidate pairs whose spheres touch while both move by their velocity for timeStep, with the time
+// into the step they first touch, 0 for pairs that already overlap
+void findSweptContacts(const ParticleStore& particles, const std::vector<std::pair<unsigned int, unsigned int>>& candidates, float timeStep, std::vector<std::pair<unsigned int, unsigned int>>& contacts, std::vector<float>& impactTimes);
+
+#endif
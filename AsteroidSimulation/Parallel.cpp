@@ -0,0 +1,113 @@
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include "Parallel.h"
+#include "ThreadPool.h"
+
+namespace {
+	// a few chunks per thread so stealing can even out chunks that take longer
+	const unsigned int chunksPerWorker = 4;
+
+	std::unique_ptr<ThreadPool> threadPool; // never replaced once created, other simulations may be running on it
+	std::once_flag threadPoolStart;         // simulations on different threads may start the pool at the same time
+	std::mutex workerCountMutex;            // keeps setWorkerCount from changing the count while the pool starts
+	unsigned int requestedWorkerCount = 0;
+	bool threadPoolStarted = false;
+
+	ThreadPool& getThreadPool() {
+		// every parallelFor asks for the pool, after the first call this only checks the flag
+		std::call_once(threadPoolStart, [] {
+			unsigned int count;
+			{
+				std::lock_guard<std::mutex> lock(workerCountMutex);
+				count = requestedWorkerCount;
+				threadPoolStarted = true;
+			}
+			if (count == 0) {
+				count = std::max(1u, std::thread::hardware_concurrency());
+			}
+			threadPool.reset(new ThreadPool(count));
+		});
+		return *threadPool;
+	}
+}
+
+bool setWorkerCount(unsigned int count) {
+	std::lock_guard<std::mutex> lock(workerCountMutex);
+	if (threadPoolStarted) {
+		return false;
+	}
+	requestedWorkerCount = count;
+	return true;
+}
+
+unsigned int getWorkerCount() {
+	return getThreadPool().getThreadCount();
+}
+
+void parallelFor(unsigned int count, const std::function<void(unsigned int begin, unsigned int end)>& body) {
+	ThreadPool& pool = getThreadPool();
+	unsigned int chunkCount = std::min(pool.getThreadCount() * chunksPerWorker, count);
+
+	pool.run(chunkCount, [&](unsigned int chunk) {
+		unsigned int begin = (unsigned int)((unsigned long long)count * chunk / chunkCount);
+		unsigned int end = (unsigned int)((unsigned long long)count * (chunk + 1) / chunkCount);
+		body(begin, end);
+	});
+}
+
+void parallelRadixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, std::vector<uint32_t>& keyScratch, std::vector<uint32_t>& valueScratch, int keyBits) {
+	const int radixBits = 8;
+	const unsigned int bucketCount = 1 << radixBits;
+
+	unsigned int count = (unsigned int)keys.size();
+	unsigned int chunkCount = std::max(1u, std::min(getWorkerCount(), count));
+	std::vector<unsigned int> offsets(chunkCount * bucketCount);
+
+	keyScratch.resize(count);
+	valueScratch.resize(count);
+
+	// least significant digit first, each pass is stable so earlier digits stay in order
+	for (int shift = 0; shift < keyBits; shift += radixBits) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+
+		// each chunk counts its own digits
+		parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+			for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+				unsigned int begin = (unsigned int)((unsigned long long)count * chunk / chunkCount);
+				unsigned int end = (unsigned int)((unsigned long long)count * (chunk + 1) / chunkCount);
+				unsigned int* histogram = &offsets[chunk * bucketCount];
+				for (unsigned int i = begin; i < end; i++) {
+					histogram[(keys[i] >> shift) & (bucketCount - 1)]++;
+				}
+			}
+		});
+
+		// exclusive scan in digit major order keeps the sort stable across chunks
+		unsigned int sum = 0;
+		for (unsigned int bucket = 0; bucket < bucketCount; bucket++) {
+			for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+				unsigned int bucketSize = offsets[chunk * bucketCount + bucket];
+				offsets[chunk * bucketCount + bucket] = sum;
+				sum += bucketSize;
+			}
+		}
+
+		parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+			for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+				unsigned int begin = (unsigned int)((unsigned long long)count * chunk / chunkCount);
+				unsigned int end = (unsigned int)((unsigned long long)count * (chunk + 1) / chunkCount);
+				unsigned int* offset = &offsets[chunk * bucketCount];
+				for (unsigned int i = begin; i < end; i++) {
+					unsigned int destination = offset[(keys[i] >> shift) & (bucketCount - 1)]++;
+					keyScratch[destination] = keys[i];
+					valueScratch[destination] = values[i];
+				}
+			}
+		});
+
+		keys.swap(keyScratch);
+		values.swap(valueScratch);
+	}
+}
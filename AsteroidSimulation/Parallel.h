@@ -0,0 +1,21 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// number of threads every simulation shares, 0 uses every hardware thread, only takes effect before the
+// first parallel work starts the pool, returns false once the pool is running and its count is fixed
+bool setWorkerCount(unsigned int count);
+
+// number of threads parallelFor splits work across
+unsigned int getWorkerCount();
+
+// split [0, count) into contiguous chunks and run body(begin, end) for each chunk on the thread pool
+void parallelFor(unsigned int count, const std::function<void(unsigned int begin, unsigned int end)>& body);
+
+// stable parallel sort of keys and their values by the low keyBits bits of the keys, the scratch vectors are reused between calls
+void parallelRadixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, std::vector<uint32_t>& keyScratch, std::vector<uint32_t>& valueScratch, int keyBits);
+
+#endif
@@ -0,0 +1,312 @@
+#include <cmath>
+#include <algorithm>
+#include "ParticleMeshGravity.h"
+#include "Parallel.h"
+
+namespace {
+	const float pi = 3.14159265f;
+
+	// softening of the grid kernel in cells, keeps a fragment's own cell finite
+	const float kernelSoftening = 0.5f;
+
+	cy::Vec3f minimum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+	}
+
+	cy::Vec3f maximum(const cy::Vec3f& a, const cy::Vec3f& b) {
+		return cy::Vec3f(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+	}
+
+	// plain complex product, operator* checks for infinities and is much slower in the inner loops
+	std::complex<float> multiply(const std::complex<float>& a, const std::complex<float>& b) {
+		return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+	// cell below the point and the point's offset inside it, clamped so the cell above is still on the grid
+	void getCell(float coordinate, unsigned int gridSize, unsigned int& cell, float& offset) {
+		coordinate = std::min(std::max(coordinate, 0.0f), (float)(gridSize - 1));
+		cell = std::min((unsigned int)coordinate, gridSize - 2);
+		offset = coordinate - (float)cell;
+	}
+}
+
+void ParticleMeshGravity::build(const ParticleStore& particles, float gravitationalConstant, unsigned int resolution) {
+	solved = particles.size() >= 2;
+	if (!solved) {
+		return;
+	}
+
+	setResolution(resolution);
+	fitGrid(particles);
+	depositMass(particles);
+	computeForces(gravitationalConstant);
+}
+
+void ParticleMeshGravity::computeAccelerations(const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations) const {
+	accelerations.resize(active.size());
+	if (!solved) {
+		std::fill(accelerations.begin(), accelerations.end(), cy::Vec3f(0.0f, 0.0f, 0.0f));
+		return;
+	}
+
+	parallelFor((unsigned int)active.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int n = begin; n < end; n++) {
+			accelerations[n] = interpolateForce(particles, active[n]);
+		}
+	});
+}
+
+void ParticleMeshGravity::setResolution(unsigned int resolution) {
+	// round up to a power of two for the radix 2 FFT
+	unsigned int powerOfTwo = 2;
+	while (powerOfTwo < resolution) {
+		powerOfTwo *= 2;
+	}
+	resolution = powerOfTwo;
+	if (resolution == gridSize) {
+		return;
+	}
+
+	gridSize = resolution;
+	paddedSize = 2 * resolution;
+	logPaddedSize = 0;
+	while ((1u << logPaddedSize) < paddedSize) {
+		logPaddedSize++;
+	}
+
+	twiddles.resize(paddedSize / 2);
+	for (unsigned int k = 0; k < paddedSize / 2; k++) {
+		float angle = -2.0f * pi * (float)k / (float)paddedSize;
+		twiddles[k] = ComplexFloat(std::cos(angle), std::sin(angle));
+	}
+
+	bitReversed.resize(paddedSize);
+	for (unsigned int i = 0; i < paddedSize; i++) {
+		unsigned int reversed = 0;
+		for (unsigned int bit = 0; bit < logPaddedSize; bit++) {
+			reversed |= ((i >> bit) & 1u) << (logPaddedSize - 1 - bit);
+		}
+		bitReversed[i] = reversed;
+	}
+
+	// distances wrap around the padded grid, so each cell of the cloud sees every other one exactly once
+	unsigned int paddedCells = paddedSize * paddedSize * paddedSize;
+	greenTransform.resize(paddedCells);
+	parallelFor(paddedSize * paddedSize, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int line = begin; line < end; line++) {
+			unsigned int y = line % paddedSize;
+			unsigned int z = line / paddedSize;
+			float dy = (float)std::min(y, paddedSize - y);
+			float dz = (float)std::min(z, paddedSize - z);
+			for (unsigned int x = 0; x < paddedSize; x++) {
+				float dx = (float)std::min(x, paddedSize - x);
+				greenTransform[line * paddedSize + x] = ComplexFloat(1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + kernelSoftening * kernelSoftening), 0.0f);
+			}
+		}
+	});
+
+	transformAxis(greenTransform, 0, paddedSize, paddedSize, false);
+	transformAxis(greenTransform, 1, paddedSize, paddedSize, false);
+	transformAxis(greenTransform, 2, paddedSize, paddedSize, false);
+
+	grid.resize(paddedCells);
+	forceX.resize(gridSize * gridSize * gridSize);
+	forceY.resize(gridSize * gridSize * gridSize);
+	forceZ.resize(gridSize * gridSize * gridSize);
+}
+
+void ParticleMeshGravity::fitGrid(const ParticleStore& particles) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	unsigned int chunkCount = getWorkerCount();
+	std::vector<cy::Vec3f> chunkMin(chunkCount, particles.getPosition(0));
+	std::vector<cy::Vec3f> chunkMax(chunkCount, particles.getPosition(0));
+
+	// bounds of the particle centers
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)particleCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)particleCount * (chunk + 1) / chunkCount);
+			for (unsigned int i = begin; i < end; i++) {
+				chunkMin[chunk] = minimum(chunkMin[chunk], particles.getPosition(i));
+				chunkMax[chunk] = maximum(chunkMax[chunk], particles.getPosition(i));
+			}
+		}
+	});
+
+	cy::Vec3f sceneMin = chunkMin[0];
+	cy::Vec3f sceneMax = chunkMax[0];
+	for (unsigned int chunk = 1; chunk < chunkCount; chunk++) {
+		sceneMin = minimum(sceneMin, chunkMin[chunk]);
+		sceneMax = maximum(sceneMax, chunkMax[chunk]);
+	}
+
+	// a cube so the cells are cubes and one kernel fits every axis
+	gridMin = sceneMin;
+	cellSize = std::max((sceneMax - sceneMin).Max(), 1e-6f) / (float)(gridSize - 1);
+}
+
+void ParticleMeshGravity::depositMass(const ParticleStore& particles) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	float inverseCellSize = 1.0f / cellSize;
+
+	// sort the particles by x cell so every x plane of the grid can be filled by one thread
+	cellColumns.resize(particleCount);
+	sortedParticles.resize(particleCount);
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			float offset;
+			getCell((particles.x[i] - gridMin.x) * inverseCellSize, gridSize, cellColumns[i], offset);
+			sortedParticles[i] = i;
+		}
+	});
+
+	int columnBits = 1;
+	while ((1u << columnBits) < gridSize) {
+		columnBits++;
+	}
+	parallelRadixSort(cellColumns, sortedParticles, columnScratch, particleScratch, columnBits);
+
+	std::fill(grid.begin(), grid.end(), ComplexFloat(0.0f, 0.0f));
+
+	// plane x takes the particles of cell x - 1 and cell x, in sorted order so the sums do not depend on the thread count
+	parallelFor(gridSize, [&](unsigned int firstPlane, unsigned int lastPlane) {
+		for (unsigned int plane = firstPlane; plane < lastPlane; plane++) {
+			unsigned int firstColumn = plane > 0 ? plane - 1 : 0;
+			unsigned int begin = (unsigned int)(std::lower_bound(cellColumns.begin(), cellColumns.end(), firstColumn) - cellColumns.begin());
+			unsigned int end = (unsigned int)(std::upper_bound(cellColumns.begin(), cellColumns.end(), plane) - cellColumns.begin());
+
+			for (unsigned int k = begin; k < end; k++) {
+				unsigned int i = sortedParticles[k];
+				unsigned int cellX, cellY, cellZ;
+				float offsetX, offsetY, offsetZ;
+				getCell((particles.x[i] - gridMin.x) * inverseCellSize, gridSize, cellX, offsetX);
+				getCell((particles.y[i] - gridMin.y) * inverseCellSize, gridSize, cellY, offsetY);
+				getCell((particles.z[i] - gridMin.z) * inverseCellSize, gridSize, cellZ, offsetZ);
+
+				float weightX = cellX == plane ? 1.0f - offsetX : offsetX;
+				for (unsigned int dz = 0; dz < 2; dz++) {
+					float weightZ = dz ? offsetZ : 1.0f - offsetZ;
+					for (unsigned int dy = 0; dy < 2; dy++) {
+						float weightY = dy ? offsetY : 1.0f - offsetY;
+						grid[((cellZ + dz) * paddedSize + cellY + dy) * paddedSize + plane] += particles.mass[i] * weightX * weightY * weightZ;
+					}
+				}
+			}
+		}
+	});
+}
+
+void ParticleMeshGravity::computeForces(float gravitationalConstant) {
+	// only the cloud's corner of the padded grid holds mass, so the lines outside it stay zero until the last axis
+	transformAxis(grid, 0, gridSize, gridSize, false);
+	transformAxis(grid, 1, paddedSize, gridSize, false);
+	transformAxis(grid, 2, paddedSize, paddedSize, false);
+
+	parallelFor((unsigned int)grid.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int cell = begin; cell < end; cell++) {
+			grid[cell] = multiply(grid[cell], greenTransform[cell]);
+		}
+	});
+
+	// only the cloud's corner of the potential is needed
+	transformAxis(grid, 2, paddedSize, paddedSize, true);
+	transformAxis(grid, 1, paddedSize, gridSize, true);
+	transformAxis(grid, 0, gridSize, gridSize, true);
+
+	// the kernel is in cells and the inverse FFT is unscaled, the potential is -G * sum(m / r)
+	float potentialScale = -gravitationalConstant / (cellSize * (float)paddedSize * (float)paddedSize * (float)paddedSize);
+	float gradientScale = -potentialScale / (2.0f * cellSize);
+
+	// acceleration is minus the gradient of the potential, central differences inside and one sided at the edges
+	parallelFor(gridSize * gridSize, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int line = begin; line < end; line++) {
+			unsigned int y = line % gridSize;
+			unsigned int z = line / gridSize;
+			for (unsigned int x = 0; x < gridSize; x++) {
+				unsigned int xLow = x > 0 ? x - 1 : x, xHigh = x + 1 < gridSize ? x + 1 : x;
+				unsigned int yLow = y > 0 ? y - 1 : y, yHigh = y + 1 < gridSize ? y + 1 : y;
+				unsigned int zLow = z > 0 ? z - 1 : z, zHigh = z + 1 < gridSize ? z + 1 : z;
+
+				unsigned int row = (z * paddedSize + y) * paddedSize;
+				float dx = grid[row + xHigh].real() - grid[row + xLow].real();
+				float dy = grid[(z * paddedSize + yHigh) * paddedSize + x].real() - grid[(z * paddedSize + yLow) * paddedSize + x].real();
+				float dz = grid[(zHigh * paddedSize + y) * paddedSize + x].real() - grid[(zLow * paddedSize + y) * paddedSize + x].real();
+
+				unsigned int cell = line * gridSize + x;
+				forceX[cell] = gradientScale * dx * 2.0f / (float)(xHigh - xLow);
+				forceY[cell] = gradientScale * dy * 2.0f / (float)(yHigh - yLow);
+				forceZ[cell] = gradientScale * dz * 2.0f / (float)(zHigh - zLow);
+			}
+		}
+	});
+}
+
+cy::Vec3f ParticleMeshGravity::interpolateForce(const ParticleStore& particles, unsigned int i) const {
+	float inverseCellSize = 1.0f / cellSize;
+
+	// the same weights that spread the mass, so a fragment does not pull on itself
+	unsigned int cellX, cellY, cellZ;
+	float offsetX, offsetY, offsetZ;
+	getCell((particles.x[i] - gridMin.x) * inverseCellSize, gridSize, cellX, offsetX);
+	getCell((particles.y[i] - gridMin.y) * inverseCellSize, gridSize, cellY, offsetY);
+	getCell((particles.z[i] - gridMin.z) * inverseCellSize, gridSize, cellZ, offsetZ);
+
+	cy::Vec3f acceleration(0.0f, 0.0f, 0.0f);
+	for (unsigned int dz = 0; dz < 2; dz++) {
+		float weightZ = dz ? offsetZ : 1.0f - offsetZ;
+		for (unsigned int dy = 0; dy < 2; dy++) {
+			float weightY = dy ? offsetY : 1.0f - offsetY;
+			for (unsigned int dx = 0; dx < 2; dx++) {
+				float weight = (dx ? offsetX : 1.0f - offsetX) * weightY * weightZ;
+				unsigned int cell = ((cellZ + dz) * gridSize + cellY + dy) * gridSize + cellX + dx;
+				acceleration += cy::Vec3f(forceX[cell], forceY[cell], forceZ[cell]) * weight;
+			}
+		}
+	}
+	return acceleration;
+}
+
+void ParticleMeshGravity::transformAxis(std::vector<ComplexFloat>& data, int axis, unsigned int firstLimit, unsigned int secondLimit, bool inverse) const {
+	unsigned int stride = axis == 0 ? 1 : axis == 1 ? paddedSize : paddedSize * paddedSize;
+
+	parallelFor(firstLimit * secondLimit, [&](unsigned int begin, unsigned int end) {
+		std::vector<ComplexFloat> line(paddedSize);
+
+		for (unsigned int index = begin; index < end; index++) {
+			unsigned int first = index % firstLimit;
+			unsigned int second = index / firstLimit;
+
+			// the other two axes in x, y, z order
+			unsigned int start;
+			if (axis == 0) {
+				start = (second * paddedSize + first) * paddedSize;
+			}
+			else if (axis == 1) {
+				start = second * paddedSize * paddedSize + first;
+			}
+			else {
+				start = second * paddedSize + first;
+			}
+
+			for (unsigned int i = 0; i < paddedSize; i++) {
+				line[bitReversed[i]] = data[start + i * stride];
+			}
+
+			// iterative radix 2 butterflies
+			for (unsigned int half = 1, twiddleStep = paddedSize / 2; half < paddedSize; half *= 2, twiddleStep /= 2) {
+				for (unsigned int group = 0; group < paddedSize; group += 2 * half) {
+					for (unsigned int k = 0; k < half; k++) {
+						ComplexFloat twiddle = inverse ? std::conj(twiddles[k * twiddleStep]) : twiddles[k * twiddleStep];
+						ComplexFloat odd = multiply(twiddle, line[group + k + half]);
+						line[group + k + half] = line[group + k] - odd;
+						line[group + k] += odd;
+					}
+				}
+			}
+
+			for (unsigned int i = 0; i < paddedSize; i++) {
+				data[start + i * stride] = line[i];
+			}
+		}
+	});
+}
@@ -0,0 +1,61 @@
+#ifndef PARTICLE_MESH_GRAVITY_H
+#define PARTICLE_MESH_GRAVITY_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Particle-mesh gravity for dense debris clouds. Fragment masses are spread onto a grid around the
+/// cloud with cloud-in-cell weights, the potential is found with FFTs on a zero padded grid so the cloud
+/// does not feel copies of itself, and the grid forces are interpolated back to the fragments. Each step
+/// costs O(N + G log G), but pulls between fragments closer than a cell or two are smoothed out.
+/// </summary>
+class ParticleMeshGravity {
+public:
+	// spread every particle's mass onto the grid and solve for the grid forces, resolution is the number of
+	// grid points along each axis of the cloud's bounding cube and is rounded up to a power of two
+	void build(const ParticleStore& particles, float gravitationalConstant, unsigned int resolution);
+
+	// gravitational acceleration of only the active particles at their current positions, accelerations[n] belongs
+	// to particle active[n], the grid keeps the forces build found so several evaluations can share one solve
+	void computeAccelerations(const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations) const;
+
+private:
+	typedef std::complex<float> ComplexFloat;
+
+	void setResolution(unsigned int resolution);
+	void fitGrid(const ParticleStore& particles);
+	void depositMass(const ParticleStore& particles);
+	void computeForces(float gravitationalConstant);
+	cy::Vec3f interpolateForce(const ParticleStore& particles, unsigned int i) const;
+
+	// FFT every line along axis, the other two axes are limited to [0, firstLimit) and [0, secondLimit)
+	void transformAxis(std::vector<ComplexFloat>& data, int axis, unsigned int firstLimit, unsigned int secondLimit, bool inverse) const;
+
+	bool solved = false;          // build had at least two particles to pull on each other
+	unsigned int gridSize = 0;    // points along each axis of the cloud
+	unsigned int paddedSize = 0;  // twice gridSize so the FFT does not wrap around
+	unsigned int logPaddedSize = 0;
+
+	cy::Vec3f gridMin;
+	float cellSize = 1.0f;
+
+	std::vector<ComplexFloat> twiddles;
+	std::vector<uint32_t> bitReversed;
+	std::vector<ComplexFloat> greenTransform; // transform of 1 / distance in cells, only depends on the resolution
+
+	std::vector<uint32_t> cellColumns;   // x cell of each particle, sorted
+	std::vector<uint32_t> sortedParticles;
+	std::vector<uint32_t> columnScratch;
+	std::vector<uint32_t> particleScratch;
+
+	std::vector<ComplexFloat> grid;           // masses, then the potential
+	std::vector<float> forceX;
+	std::vector<float> forceY;
+	std::vector<float> forceZ;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "ParticleSnapshot.h"
+#include "Parallel.h"
+
+void ParticleSnapshot::capture(const ParticleStore& particles) {
+	size_t count = particles.size();
+	previousPositions.resize(count);
+	positions.resize(count);
+	scale.resize(count);
+
+	// on all cores, so an explosion's worth of new particles does not stall the step that publishes it
+	parallelFor((unsigned int)count, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			previousPositions[i] = cy::Vec3f(particles.previousX[i], particles.previousY[i], particles.previousZ[i]);
+			positions[i] = particles.getPosition(i);
+			scale[i] = particles.scale[i];
+		}
+	});
+}
+
+cy::Matrix4f ParticleSnapshot::getModelMatrix(size_t i, float interpolation) const {
+	cy::Matrix4f modelMatrix;
+	modelMatrix.SetScale(scale[i]);
+	modelMatrix.SetTranslationComponent(previousPositions[i] + (positions[i] - previousPositions[i]) * interpolation);
+	return modelMatrix;
+}
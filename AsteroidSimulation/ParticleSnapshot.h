@@ -0,0 +1,28 @@
+#ifndef PARTICLE_SNAPSHOT_H
+#define PARTICLE_SNAPSHOT_H
+
+#include <vector>
+#include "cyMatrix.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Copy of what drawing needs from the particles after a physics step, so the render thread never
+/// reads the particle store while the simulation thread changes it. Keeps the positions before and
+/// after the step so a frame can be drawn between them.
+/// </summary>
+class ParticleSnapshot {
+public:
+	std::vector<cy::Vec3f> previousPositions;
+	std::vector<cy::Vec3f> positions;
+	std::vector<float> scale;
+
+	// copy the particles, reusing this snapshot's memory
+	void capture(const ParticleStore& particles);
+
+	size_t size() const { return positions.size(); }
+
+	// model matrix at the position blended between the previous step (0) and the current one (1)
+	cy::Matrix4f getModelMatrix(size_t i, float interpolation) const;
+};
+
+#endif
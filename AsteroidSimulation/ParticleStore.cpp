@@ -0,0 +1,265 @@
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <vector>
+#include "ParticleStore.h"
+#include "Parallel.h"
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+void* alignedAllocate(size_t bytes) {
+	void* memory = nullptr;
+#ifdef _MSC_VER
+	memory = _aligned_malloc(bytes, AlignedArray<float>::alignment);
+#else
+	if (posix_memalign(&memory, AlignedArray<float>::alignment, bytes) != 0) {
+		memory = nullptr;
+	}
+#endif
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void alignedFree(void* memory) {
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+void ParticleStore::reserve(size_t capacity) {
+	x.reserve(capacity);
+	y.reserve(capacity);
+	z.reserve(capacity);
+	previousX.reserve(capacity);
+	previousY.reserve(capacity);
+	previousZ.reserve(capacity);
+	vx.reserve(capacity);
+	vy.reserve(capacity);
+	vz.reserve(capacity);
+	radius.reserve(capacity);
+	mass.reserve(capacity);
+	scale.reserve(capacity);
+	parent.reserve(capacity);
+	asleep.reserve(capacity);
+	depth.reserve(capacity);
+}
+
+void ParticleStore::clear() {
+	x.clear();
+	y.clear();
+	z.clear();
+	previousX.clear();
+	previousY.clear();
+	previousZ.clear();
+	vx.clear();
+	vy.clear();
+	vz.clear();
+	radius.clear();
+	mass.clear();
+	scale.clear();
+	parent.clear();
+	asleep.clear();
+	depth.clear();
+}
+
+size_t ParticleStore::add(size_t count) {
+	size_t first = size();
+	size_t newSize = first + count;
+
+	x.resize(newSize);
+	y.resize(newSize);
+	z.resize(newSize);
+	previousX.resize(newSize);
+	previousY.resize(newSize);
+	previousZ.resize(newSize);
+	vx.resize(newSize);
+	vy.resize(newSize);
+	vz.resize(newSize);
+	radius.resize(newSize);
+	mass.resize(newSize);
+	scale.resize(newSize);
+	parent.resize(newSize);
+	asleep.resize(newSize);
+	depth.resize(newSize);
+
+	for (size_t i = first; i < newSize; i++) {
+		x[i] = y[i] = z[i] = 0.0f;
+		previousX[i] = previousY[i] = previousZ[i] = 0.0f;
+		vx[i] = vy[i] = vz[i] = 0.0f;
+		radius[i] = 0.0f;
+		mass[i] = 0.0f;
+		scale[i] = 1.0f;
+		parent[i] = 0;
+		asleep[i] = 0;
+		depth[i] = 0;
+	}
+
+	return first;
+}
+
+void ParticleStore::remove(size_t i) {
+	size_t last = size() - 1;
+
+	if (i != last) {
+		x[i] = x[last];
+		y[i] = y[last];
+		z[i] = z[last];
+		previousX[i] = previousX[last];
+		previousY[i] = previousY[last];
+		previousZ[i] = previousZ[last];
+		vx[i] = vx[last];
+		vy[i] = vy[last];
+		vz[i] = vz[last];
+		radius[i] = radius[last];
+		mass[i] = mass[last];
+		scale[i] = scale[last];
+		parent[i] = parent[last];
+		asleep[i] = asleep[last];
+		depth[i] = depth[last];
+	}
+
+	x.resize(last);
+	y.resize(last);
+	z.resize(last);
+	previousX.resize(last);
+	previousY.resize(last);
+	previousZ.resize(last);
+	vx.resize(last);
+	vy.resize(last);
+	vz.resize(last);
+	radius.resize(last);
+	mass.resize(last);
+	scale.resize(last);
+	parent.resize(last);
+	asleep.resize(last);
+	depth.resize(last);
+}
+
+bool ParticleStore::checkCollision(size_t i, size_t j) const {
+	// compare squared distances so no square root is needed
+	float dx = x[j] - x[i];
+	float dy = y[j] - y[i];
+	float dz = z[j] - z[i];
+	float radiusSum = radius[i] + radius[j];
+
+	return dx * dx + dy * dy + dz * dz <= radiusSum * radiusSum;
+}
+
+void ParticleStore::getCollisionResponse(size_t i, size_t j, cy::Vec3f& deltaI, cy::Vec3f& deltaJ) const {
+	cy::Vec3f velocity = getVelocity(i);
+	cy::Vec3f otherVelocity = getVelocity(j);
+
+	cy::Vec3f momentum = mass[i] * velocity + mass[j] * otherVelocity;
+	cy::Vec3f centerOfMassVelocity = momentum / (mass[i] + mass[j]);
+
+	// both lose their motion relative to the center of mass, so the pair keeps its momentum and debris can settle
+	deltaI = centerOfMassVelocity - velocity;
+	deltaJ = centerOfMassVelocity - otherVelocity;
+}
+
+float ParticleStore::getMaxTravel(float timeStep) const {
+	unsigned int particleCount = (unsigned int)size();
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), particleCount));
+	std::vector<float> chunkMax(chunkCount, 0.0f);
+
+	// each chunk keeps its own maximum, compared as squares so no square root is needed per particle
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)particleCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)particleCount * (chunk + 1) / chunkCount);
+			for (unsigned int i = begin; i < end; i++) {
+				if (radius[i] > 0.0f) {
+					float speedSquared = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+					chunkMax[chunk] = std::max(chunkMax[chunk], speedSquared / (radius[i] * radius[i]));
+				}
+			}
+		}
+	});
+
+	float maxSquared = *std::max_element(chunkMax.begin(), chunkMax.end());
+	return std::sqrt(maxSquared) * timeStep;
+}
+
+void ParticleStore::getMaxRadiusAndSpeed(float& maxRadius, float& maxSpeed) const {
+	unsigned int particleCount = (unsigned int)size();
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), particleCount));
+	std::vector<float> chunkRadius(chunkCount, 0.0f);
+	std::vector<float> chunkSpeedSquared(chunkCount, 0.0f);
+
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)particleCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)particleCount * (chunk + 1) / chunkCount);
+			for (unsigned int i = begin; i < end; i++) {
+				chunkRadius[chunk] = std::max(chunkRadius[chunk], radius[i]);
+				chunkSpeedSquared[chunk] = std::max(chunkSpeedSquared[chunk], vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+			}
+		}
+	});
+
+	maxRadius = *std::max_element(chunkRadius.begin(), chunkRadius.end());
+	maxSpeed = std::sqrt(*std::max_element(chunkSpeedSquared.begin(), chunkSpeedSquared.end()));
+}
+
+float ParticleStore::getMaxClosingTravel(const std::vector<std::pair<unsigned int, unsigned int>>& pairs, float timeStep) const {
+	unsigned int pairCount = (unsigned int)pairs.size();
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), pairCount));
+	std::vector<float> chunkMax(chunkCount, 0.0f);
+
+	// pairs moving apart or past each other do not close in, only the speed along the line between the centers counts
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)pairCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)pairCount * (chunk + 1) / chunkCount);
+			for (unsigned int p = begin; p < end; p++) {
+				unsigned int i = pairs[p].first;
+				unsigned int j = pairs[p].second;
+				float dx = x[j] - x[i];
+				float dy = y[j] - y[i];
+				float dz = z[j] - z[i];
+				float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+				float contactDistance = radius[i] + radius[j];
+				if (distance <= 0.0f || contactDistance <= 0.0f) {
+					continue;
+				}
+
+				float closing = -((vx[j] - vx[i]) * dx + (vy[j] - vy[i]) * dy + (vz[j] - vz[i]) * dz) / distance;
+				chunkMax[chunk] = std::max(chunkMax[chunk], closing / contactDistance);
+			}
+		}
+	});
+
+	return *std::max_element(chunkMax.begin(), chunkMax.end()) * timeStep;
+}
+
+void ParticleStore::savePositions() {
+	size_t count = size();
+	if (count > 0) {
+		memcpy(previousX.data(), x.data(), count * sizeof(float));
+		memcpy(previousY.data(), y.data(), count * sizeof(float));
+		memcpy(previousZ.data(), z.data(), count * sizeof(float));
+	}
+}
+
+void ParticleStore::updatePositions(float timeStep) {
+	float* px = x.data();
+	float* py = y.data();
+	float* pz = z.data();
+	const float* pvx = vx.data();
+	const float* pvy = vy.data();
+	const float* pvz = vz.data();
+
+	parallelFor((unsigned int)size(), [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			px[i] += pvx[i] * timeStep;
+			py[i] += pvy[i] * timeStep;
+			pz[i] += pvz[i] * timeStep;
+		}
+	});
+}
@@ -0,0 +1,143 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyMatrix.h"
+
+void* alignedAllocate(size_t bytes);
+void alignedFree(void* memory);
+
+/// <summary>
+/// Growable array whose storage is aligned to a cache line, so SIMD loops can use aligned loads
+/// </summary>
+template <typename T>
+class AlignedArray {
+public:
+	static const size_t alignment = 64;
+
+	AlignedArray() : elements(nullptr), count(0), capacity(0) {}
+	~AlignedArray() { alignedFree(elements); }
+
+	AlignedArray(const AlignedArray&) = delete;
+	AlignedArray& operator=(const AlignedArray&) = delete;
+
+	void reserve(size_t newCapacity) {
+		if (newCapacity <= capacity) {
+			return;
+		}
+
+		T* newElements = (T*)alignedAllocate(newCapacity * sizeof(T));
+		if (count > 0) {
+			memcpy(newElements, elements, count * sizeof(T));
+		}
+		alignedFree(elements);
+
+		elements = newElements;
+		capacity = newCapacity;
+	}
+
+	void resize(size_t newCount) {
+		if (newCount > capacity) {
+			reserve(newCount > 2 * capacity ? newCount : 2 * capacity);
+		}
+		count = newCount;
+	}
+
+	void clear() { count = 0; }
+
+	size_t size() const { return count; }
+	size_t getCapacity() const { return capacity; }
+
+	T* data() { return elements; }
+	const T* data() const { return elements; }
+
+	T& operator[](size_t i) { return elements[i]; }
+	const T& operator[](size_t i) const { return elements[i]; }
+
+private:
+	T* elements;
+	size_t count;
+	size_t capacity;
+};
+
+/// <summary>
+/// Structure of arrays storage for asteroid particles. The simulation loops only touch the arrays
+/// they need, and model matrices are only built when a particle is drawn. The particles stay packed
+/// at the front of the arrays, removing one moves the last particle into its place, and the memory is
+/// kept so long runs that add and remove particles do not allocate.
+/// </summary>
+class ParticleStore {
+public:
+	AlignedArray<float> x, y, z;
+	AlignedArray<float> previousX, previousY, previousZ; // positions before the last step, for drawing between steps
+	AlignedArray<float> vx, vy, vz;
+	AlignedArray<float> radius;
+	AlignedArray<float> mass;
+	AlignedArray<float> scale;
+	AlignedArray<uint16_t> parent;       // which asteroid the particle broke off from
+	AlignedArray<unsigned char> asleep;  // resting particles are skipped by the integrator until something wakes them
+	AlignedArray<unsigned char> depth;   // times the particle's ancestors broke up since the parent body, 0 for the first fragments
+
+	void reserve(size_t capacity);
+	void clear();
+
+	// append a particle at the origin with no velocity and return its index
+	size_t add() { return add(1); }
+
+	// append count particles at the origin with no velocity and return the index of the first
+	size_t add(size_t count);
+
+	// remove particle i in O(1) by moving the last particle into its place, so the last particle's index becomes i
+	void remove(size_t i);
+
+	size_t size() const { return x.size(); }
+
+	// particles that fit before the arrays have to grow
+	size_t getCapacity() const { return x.getCapacity(); }
+
+	cy::Vec3f getPosition(size_t i) const { return cy::Vec3f(x[i], y[i], z[i]); }
+	cy::Vec3f getVelocity(size_t i) const { return cy::Vec3f(vx[i], vy[i], vz[i]); }
+
+	// placing a particle also moves its previous position, so it is not drawn sliding in from the old one
+	void setPosition(size_t i, const cy::Vec3f& position) {
+		x[i] = previousX[i] = position.x;
+		y[i] = previousY[i] = position.y;
+		z[i] = previousZ[i] = position.z;
+	}
+	void setVelocity(size_t i, const cy::Vec3f& velocity) { vx[i] = velocity.x; vy[i] = velocity.y; vz[i] = velocity.z; }
+
+	// bounding box of the sphere over the next sweepTime of motion, 0 gives the box of the sphere where it is
+	void getBounds(size_t i, float sweepTime, cy::Vec3f& boundsMin, cy::Vec3f& boundsMax) const {
+		cy::Vec3f start = getPosition(i);
+		cy::Vec3f end = start + getVelocity(i) * sweepTime;
+		boundsMin = cy::Vec3f(std::min(start.x, end.x), std::min(start.y, end.y), std::min(start.z, end.z)) - radius[i];
+		boundsMax = cy::Vec3f(std::max(start.x, end.x), std::max(start.y, end.y), std::max(start.z, end.z)) + radius[i];
+	}
+
+	bool checkCollision(size_t i, size_t j) const;
+
+	// velocity change of both particles when i and j hit each other, they move on with their common velocity
+	void getCollisionResponse(size_t i, size_t j, cy::Vec3f& deltaI, cy::Vec3f& deltaJ) const;
+
+	// largest distance any particle moves in timeStep, measured in its own radii
+	float getMaxTravel(float timeStep) const;
+
+	// largest radius and largest speed of any particle, found in one pass
+	void getMaxRadiusAndSpeed(float& maxRadius, float& maxSpeed) const;
+
+	// largest distance any of the pairs closes in on each other in timeStep, measured in their radii summed
+	float getMaxClosingTravel(const std::vector<std::pair<unsigned int, unsigned int>>& pairs, float timeStep) const;
+
+	// remember the current positions as the previous ones, call before each physics step
+	void savePositions();
+
+	// move every particle by its velocity times timeStep
+	void updatePositions(float timeStep);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <cmath>
+#include <algorithm>
+#include "PoissonDiskPlacement.h"
+#include "RandomStream.h"
+#include "Parallel.h"
+
+namespace {
+	// placement draws from streams far above the ones fragments are generated from
+	const uint64_t placementStreams = (uint64_t)1 << 48;
+
+	const uint32_t cellBits = 10; // cells along each axis, as bits of the cell key
+	const uint32_t axisMask = (1u << cellBits) - 1;
+
+	inline uint32_t getCellKey(uint32_t x, uint32_t y, uint32_t z) {
+		return x | (y << cellBits) | (z << (2 * cellBits));
+	}
+}
+
+size_t PoissonDiskPlacement::place(ParticleStore& fragments, const std::vector<uint32_t>& indices, unsigned int attempts, uint64_t seed) {
+	unsigned int count = (unsigned int)indices.size();
+	if (count == 0) {
+		return 0;
+	}
+
+	cy::Vec3f boundsMin = fragments.getPosition(indices[0]);
+	cy::Vec3f boundsMax = boundsMin;
+	float maxRadius = 0.0f;
+	for (uint32_t i : indices) {
+		cy::Vec3f position = fragments.getPosition(i);
+		boundsMin = cy::Vec3f(std::min(boundsMin.x, position.x), std::min(boundsMin.y, position.y), std::min(boundsMin.z, position.z));
+		boundsMax = cy::Vec3f(std::max(boundsMax.x, position.x), std::max(boundsMax.y, position.y), std::max(boundsMax.z, position.z));
+		maxRadius = std::max(maxRadius, fragments.radius[i]);
+	}
+
+	// a fragment can only touch fragments of its own and the neighbouring cells, and the cells along an axis fit the key
+	cy::Vec3f extent = boundsMax - boundsMin;
+	float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	cellSize = std::max(2.0f * maxRadius, largestExtent / (float)axisMask);
+	if (cellSize <= 0.0f) {
+		return 0;
+	}
+	gridMin = boundsMin;
+
+	fragmentKeys.resize(count);
+	fragmentOrder.resize(count);
+	parallelFor(count, [&](unsigned int first, unsigned int last) {
+		for (unsigned int n = first; n < last; n++) {
+			cy::Vec3f cell = (fragments.getPosition(indices[n]) - gridMin) / cellSize;
+			uint32_t x = (uint32_t)std::min(std::max(cell.x, 0.0f), (float)axisMask);
+			uint32_t y = (uint32_t)std::min(std::max(cell.y, 0.0f), (float)axisMask);
+			uint32_t z = (uint32_t)std::min(std::max(cell.z, 0.0f), (float)axisMask);
+			fragmentKeys[n] = getCellKey(x, y, z);
+			fragmentOrder[n] = indices[n];
+		}
+	});
+
+	// stable, so the fragments of a cell stay in index order
+	parallelRadixSort(fragmentKeys, fragmentOrder, keyScratch, orderScratch, 3 * cellBits);
+
+	cellKeys.clear();
+	cellStarts.clear();
+	for (unsigned int n = 0; n < count; n++) {
+		if (n == 0 || fragmentKeys[n] != fragmentKeys[n - 1]) {
+			cellKeys.push_back(fragmentKeys[n]);
+			cellStarts.push_back(n);
+		}
+	}
+	cellStarts.push_back(count);
+
+	placedCounts.assign(cellKeys.size(), 0);
+	candidateFailures.assign(count, 0);
+	cellOverlaps.assign(cellKeys.size(), 0);
+
+	for (std::vector<uint32_t>& cells : parityCells) {
+		cells.clear();
+	}
+	for (uint32_t cell = 0; cell < (uint32_t)cellKeys.size(); cell++) {
+		uint32_t key = cellKeys[cell];
+		uint32_t parity = (key & 1) | (((key >> cellBits) & 1) << 1) | (((key >> (2 * cellBits)) & 1) << 2);
+		parityCells[parity].push_back(cell);
+	}
+
+	// cells of one parity are a cell apart, wider than any pair of fragments, so they can be placed at the same time
+	for (const std::vector<uint32_t>& cells : parityCells) {
+		parallelFor((unsigned int)cells.size(), [&](unsigned int first, unsigned int last) {
+			for (unsigned int n = first; n < last; n++) {
+				placeCell(fragments, cells[n], attempts, seed);
+			}
+		});
+	}
+
+	size_t overlaps = 0;
+	for (uint32_t cellOverlap : cellOverlaps) {
+		overlaps += cellOverlap;
+	}
+	return overlaps;
+}
+
+void PoissonDiskPlacement::placeCell(ParticleStore& fragments, uint32_t cell, unsigned int attempts, uint64_t seed) {
+	uint32_t key = cellKeys[cell];
+	cy::Vec3f cellMin = gridMin + cy::Vec3f((float)(key & axisMask), (float)((key >> cellBits) & axisMask), (float)(key >> (2 * cellBits))) * cellSize;
+	cy::Vec3f cellMax = cellMin + cy::Vec3f(cellSize, cellSize, cellSize);
+
+	uint32_t neighbourCells[27];
+	unsigned int neighbourCount;
+	findNeighbourCells(cell, neighbourCells, neighbourCount);
+
+	// the placed fragments of the cell come first in its part of fragmentOrder, the ones no candidate fits around any more
+	// ahead of the active ones, like Bridson's active list
+	uint32_t start = cellStarts[cell];
+	uint32_t inactiveCount = 0;
+	unsigned int failedFragments = 0;
+
+	for (uint32_t m = start; m < cellStarts[cell + 1]; m++) {
+		uint32_t i = fragmentOrder[m];
+		float radius = fragments.radius[i];
+
+		bool placed = isFree(fragments, fragments.getPosition(i), radius, neighbourCells, neighbourCount);
+
+		// a cell where fragment after fragment found no room is full, the rest keep their drawn positions
+		RandomStream random(seed, placementStreams + i);
+		for (unsigned int attempt = 0; attempt < attempts && !placed && failedFragments < attempts; attempt++) {
+			uint32_t activeCount = placedCounts[cell] - inactiveCount;
+			uint32_t active = 0;
+
+			cy::Vec3f candidate;
+			if (activeCount > 0) {
+				// around an active placed fragment of the cell, between touching it and twice that distance
+				active = start + inactiveCount + std::min((uint32_t)(random.nextFloat() * activeCount), activeCount - 1);
+				uint32_t neighbour = fragmentOrder[active];
+				float touching = radius + fragments.radius[neighbour];
+
+				float direction[3];
+				random.fillNormal(direction, 3);
+				cy::Vec3f offset(direction[0], direction[1], direction[2]);
+				float length = std::max(offset.Length(), 1e-6f);
+				candidate = fragments.getPosition(neighbour) + offset * (touching * (1.0f + random.nextFloat()) / length);
+			}
+			else {
+				candidate = cellMin + cy::Vec3f(random.nextFloat(), random.nextFloat(), random.nextFloat()) * cellSize;
+			}
+
+			// candidates outside the cell could touch fragments placed at the same time
+			bool inside = candidate.x >= cellMin.x && candidate.y >= cellMin.y && candidate.z >= cellMin.z &&
+				candidate.x < cellMax.x && candidate.y < cellMax.y && candidate.z < cellMax.z;
+
+			if (inside && isFree(fragments, candidate, radius, neighbourCells, neighbourCount)) {
+				fragments.setPosition(i, candidate);
+				placed = true;
+			}
+			else if (activeCount > 0 && ++candidateFailures[active] >= attempts) {
+				// a fragment that failed as many candidates as a fragment may try has no room left around it
+				std::swap(fragmentOrder[active], fragmentOrder[start + inactiveCount]);
+				std::swap(candidateFailures[active], candidateFailures[start + inactiveCount]);
+				inactiveCount++;
+			}
+		}
+
+		if (placed) {
+			failedFragments = 0;
+		}
+		else {
+			// the drawn position is kept, the collisions push the fragment out later
+			cellOverlaps[cell]++;
+			failedFragments++;
+		}
+
+		// the fragment joins the placed ones of the cell as active
+		placedCounts[cell]++;
+	}
+}
+
+void PoissonDiskPlacement::findNeighbourCells(uint32_t cell, uint32_t neighbourCells[27], unsigned int& neighbourCount) const {
+	uint32_t key = cellKeys[cell];
+	int x = (int)(key & axisMask);
+	int y = (int)((key >> cellBits) & axisMask);
+	int z = (int)(key >> (2 * cellBits));
+
+	// the cell itself first, its fragments are the closest
+	neighbourCells[0] = cell;
+	neighbourCount = 1;
+
+	for (int dz = -1; dz <= 1; dz++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				int nx = x + dx, ny = y + dy, nz = z + dz;
+				if ((dx == 0 && dy == 0 && dz == 0) || nx < 0 || ny < 0 || nz < 0 || nx > (int)axisMask || ny > (int)axisMask || nz > (int)axisMask) {
+					continue;
+				}
+
+				uint32_t neighbourKey = getCellKey((uint32_t)nx, (uint32_t)ny, (uint32_t)nz);
+				std::vector<uint32_t>::const_iterator found = std::lower_bound(cellKeys.begin(), cellKeys.end(), neighbourKey);
+				if (found != cellKeys.end() && *found == neighbourKey) {
+					neighbourCells[neighbourCount++] = (uint32_t)(found - cellKeys.begin());
+				}
+			}
+		}
+	}
+}
+
+bool PoissonDiskPlacement::isFree(const ParticleStore& fragments, const cy::Vec3f& position, float radius, const uint32_t* neighbourCells, unsigned int neighbourCount) const {
+	for (unsigned int n = 0; n < neighbourCount; n++) {
+		// only the placed fragments of a cell are where they will stay
+		uint32_t cell = neighbourCells[n];
+		for (uint32_t m = cellStarts[cell]; m < cellStarts[cell] + placedCounts[cell]; m++) {
+			uint32_t j = fragmentOrder[m];
+			cy::Vec3f offset = fragments.getPosition(j) - position;
+			float touching = radius + fragments.radius[j];
+			if (offset.Dot(offset) < touching * touching) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef POISSON_DISK_PLACEMENT_H
+#define POISSON_DISK_PLACEMENT_H
+
+#include <vector>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Moves freshly generated fragments apart so none of them starts inside another. The fragments are
+/// binned into a grid of cells at least two of the largest radii wide, and each fragment keeps its drawn
+/// position when it is free. Otherwise it tries Bridson style candidates in the shell between touching and
+/// twice touching distance around fragments already placed in its cell, and random points of the cell when
+/// the cell is still empty. Cells of the same parity along all three axes never touch, so the grid is
+/// placed in eight passes with the cells of each pass on all cores, and the result does not depend on the
+/// thread count.
+/// </summary>
+class PoissonDiskPlacement {
+public:
+	// place the given fragments of the store together, trying up to attempts candidates for each fragment whose
+	// drawn position overlaps, returns the number of fragments left overlapping because no candidate was free
+	size_t place(ParticleStore& fragments, const std::vector<uint32_t>& indices, unsigned int attempts, uint64_t seed);
+
+private:
+	void placeCell(ParticleStore& fragments, uint32_t cell, unsigned int attempts, uint64_t seed);
+	void findNeighbourCells(uint32_t cell, uint32_t neighbourCells[27], unsigned int& neighbourCount) const;
+	bool isFree(const ParticleStore& fragments, const cy::Vec3f& position, float radius, const uint32_t* neighbourCells, unsigned int neighbourCount) const;
+
+	cy::Vec3f gridMin;
+	float cellSize;
+
+	std::vector<uint32_t> fragmentKeys; // cell key of every fragment, sorted together with fragmentOrder
+	std::vector<uint32_t> fragmentOrder;
+	std::vector<uint32_t> keyScratch;
+	std::vector<uint32_t> orderScratch;
+
+	std::vector<uint32_t> cellKeys;      // occupied cells in key order
+	std::vector<uint32_t> cellStarts;    // first entry of each cell in fragmentOrder, cell count + 1 entries
+	std::vector<uint32_t> placedCounts;  // fragments of each cell placed so far, they come first in the cell
+	std::vector<uint16_t> candidateFailures; // candidates that did not fit around each placed fragment, along fragmentOrder
+	std::vector<uint32_t> cellOverlaps;
+	std::vector<uint32_t> parityCells[8];
+};
+
+#endif
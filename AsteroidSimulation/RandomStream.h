@@ -0,0 +1,109 @@
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+// Philox4x32-10, scrambles a 128 bit counter with a 64 bit key into four random words
+inline void philox(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t result[4]) {
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+
+	for (int round = 0; round < 10; round++) {
+		uint64_t product0 = (uint64_t)0xD2511F53u * c0;
+		uint64_t product1 = (uint64_t)0xCD9E8D57u * c2;
+
+		c0 = (uint32_t)(product1 >> 32) ^ c1 ^ key0;
+		c1 = (uint32_t)product1;
+		c2 = (uint32_t)(product0 >> 32) ^ c3 ^ key1;
+		c3 = (uint32_t)product0;
+
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+
+	result[0] = c0;
+	result[1] = c1;
+	result[2] = c2;
+	result[3] = c3;
+}
+
+// top 24 bits of a random word as a float in [0, 1), exactly representable
+inline float randomUnit(uint32_t word) { return (float)(word >> 8) * (1.0f / 16777216.0f); }
+
+/// <summary>
+/// Counter based random numbers. A stream is a seed and a stream number, and its values are the Philox
+/// hash of the stream number and a counter, so any stream can be started anywhere without seeding state
+/// and streams never overlap. Giving every fragment its own stream makes the values the same for any number
+/// of threads. Normals come from Box-Muller, four from every block of the generator.
+/// </summary>
+class RandomStream {
+public:
+	RandomStream(uint64_t seed, uint64_t stream) : key0((uint32_t)seed), key1((uint32_t)(seed >> 32)), stream(stream) {}
+
+	// uniform in [0, 1)
+	float nextFloat() {
+		if (used == 4) {
+			nextBlock();
+		}
+		return randomUnit(block[used++]);
+	}
+
+	// normal with the given mean and standard deviation
+	float nextNormal(float mean, float deviation) {
+		float normals[1];
+		fillNormal(normals, 1);
+		return mean + deviation * normals[0];
+	}
+
+	// count standard normals, in chunks of independent blocks and plain loops the compiler can vectorize along
+	// with its vector log, sin and cos, the last block's leftover words are dropped
+	void fillNormal(float* values, size_t count) {
+		const size_t chunkSize = 64;
+		uint32_t words[chunkSize];
+		float normals[chunkSize];
+
+		for (size_t start = 0; start < count; start += chunkSize) {
+			size_t chunkCount = std::min(chunkSize, count - start);
+			size_t blockCount = (chunkCount + 3) / 4;
+
+			for (size_t b = 0; b < blockCount; b++) {
+				uint64_t blockCounter = counter + b;
+				uint32_t input[4] = { (uint32_t)blockCounter, (uint32_t)(blockCounter >> 32), (uint32_t)stream, (uint32_t)(stream >> 32) };
+				philox(input, key0, key1, words + 4 * b);
+			}
+			counter += blockCount;
+
+			// Box-Muller turns every two uniform words into two normals
+			for (size_t n = 0; n < 4 * blockCount; n += 2) {
+				float radius = std::sqrt(-2.0f * std::log(1.0f - randomUnit(words[n]))); // 1 - u is never 0
+				float angle = 6.28318531f * randomUnit(words[n + 1]);
+				normals[n] = radius * std::cos(angle);
+				normals[n + 1] = radius * std::sin(angle);
+			}
+
+			for (size_t n = 0; n < chunkCount; n++) {
+				values[start + n] = normals[n];
+			}
+		}
+		used = 4;
+	}
+
+private:
+	void nextBlock() {
+		uint32_t input[4] = { (uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)stream, (uint32_t)(stream >> 32) };
+		philox(input, key0, key1, block);
+		counter++;
+		used = 0;
+	}
+
+	uint32_t key0, key1;
+	uint64_t stream;
+	uint64_t counter = 0;
+
+	uint32_t block[4];
+	int used = 4;
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include "Simulation.h"
+#include "NarrowPhase.h"
+
+namespace {
+	const float referenceStepRate = 60.0f; // velocities and parent speeds are distances per step at this rate
+}
+
+Simulation::Simulation() {
+	gravityFunction = [this](const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations) {
+		computeGravity(particles, active, accelerations);
+	};
+	gravityKickFunction = [this](const ParticleStore& particles, const std::vector<uint32_t>& targets, const std::vector<unsigned char>& levels, const float* pairKicks, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations) {
+		computeGravityKicks(particles, targets, levels, pairKicks, kicks, accelerations);
+	};
+}
+
+void Simulation::reset() {
+	size_t fragmentCount = 0;
+	for (ParentBody& body : parentBodies) {
+		body.modelMatrix = cy::Matrix4f(1.0f);
+		body.modelMatrix.SetScale(body.scale);
+		body.modelMatrix.AddTranslation(body.startPosition);
+		body.previousPosition = body.startPosition;
+		body.radius = asteroidModelRadius * body.scale;
+		body.exploded = false;
+
+		fragmentCount += body.fragmentCount;
+	}
+
+	asteroidParticles.clear();
+	asteroidParticles.reserve(std::max((size_t)particlePoolSize, fragmentCount));
+	collisionSweep.clear();
+	gravityIntegrator.clear();
+	islandSleep.clear();
+	pairClosingRate = 0.0f;
+	particlesJoined = true;
+
+	// generate every explosion on all cores now, so the impact steps only have to move the fragments apart and copy them in
+	fragmentSpawner.clear();
+	for (size_t b = 0; b < parentBodies.size(); b++) {
+		ParentBody& body = parentBodies[b];
+		body.fragmentsBegin = fragmentSpawner.prepare(body.fragmentCount, [&](ParticleStore& fragments, size_t begin, size_t end) {
+			generateFragments(fragments, begin, end, body.fragments, asteroidModelRadius, asteroidDensity, (uint16_t)b, scenarioSeed);
+		});
+		body.fragmentsEnd = body.fragmentsBegin + body.fragmentCount;
+	}
+}
+
+void Simulation::step(unsigned int steps) {
+	// every step covers the same time, so the simulation does not depend on how often it is stepped
+	for (unsigned int n = 0; n < steps; n++) {
+		stepPhysics(referenceStepRate / stepRate);
+	}
+}
+
+void Simulation::stepPhysics(float timeStep) {
+	for (ParentBody& body : parentBodies) {
+		body.previousPosition = body.modelMatrix.GetTranslation();
+	}
+	asteroidParticles.savePositions();
+
+	std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+
+	// split the step so no pair closes in further than a fraction of their radii summed per substep, going by the
+	// pairs the broad phases found in the last step, so debris flying apart takes one substep however fast it is,
+	// right after fragments join nothing is known about their contacts and the fastest particle sets the substeps
+	float maxTravel = particlesJoined ? asteroidParticles.getMaxTravel(timeStep) : pairClosingRate * timeStep;
+	physicsSubsteps = (unsigned int)std::min((float)maxSubsteps, std::max(1.0f, std::ceil(maxTravel / maxTravelPerSubstep)));
+	pairClosingRate = 0.0f;
+	particlesJoined = false;
+
+	// update particle's positions and velocities
+	// substeps and block timesteps share one budget, every doubling of the substeps takes a level off the block
+	// timesteps so the few fastest fragments cannot split the step by both
+	blockLevelLimit = BlockTimestepIntegrator::maxLevel;
+	for (unsigned int substeps = 1; substeps < physicsSubsteps && blockLevelLimit > 0; substeps *= 2) {
+		blockLevelLimit--;
+	}
+
+	for (unsigned int substep = 0; substep < physicsSubsteps; substep++) {
+		updateParticles(timeStep / (float)physicsSubsteps);
+	}
+
+	physicsStepMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+
+	if (parentsMoving) {
+		// move the asteroids still in one piece along their paths
+		for (ParentBody& body : parentBodies) {
+			if (!body.exploded) {
+				body.modelMatrix.AddTranslation(body.velocity * timeStep);
+			}
+		}
+	}
+
+	// explode asteroids that hit another one and queue their fragments
+	collideParentBodies();
+
+	// the prepared fragments join all at once or a batch per step
+	if (fragmentSpawner.spawn(asteroidParticles, spawnBatchSize) > 0) {
+		particlesJoined = true;
+	}
+
+	despawnEscapedParticles();
+}
+
+void Simulation::updateParticles(float timeStep) {
+	// the grid's cells fit the largest box, found in the same pass as the fastest particle's motion
+	float maxRadius;
+	float maxSpeed;
+	asteroidParticles.getMaxRadiusAndSpeed(maxRadius, maxSpeed);
+
+	if (gravityEnabled) {
+		// one tree per substep, every evaluation of the block timesteps refits it to the moved particles
+		buildGravity();
+
+		// leapfrog opening half kick, fragments that move fast or feel a strong pull get shorter steps, the grid smooths
+		// out the close passes the block timesteps are for and cannot tell the levels apart, so it keeps every fragment on one
+		unsigned int levelLimit = gravitySolver == GravitySolver::ParticleMesh ? 0 : blockLevelLimit;
+		gravityIntegrator.beginStep(asteroidParticles, timeStep, maxTravelPerSubstep, gravityStepAccuracy, gravitySoftening, levelLimit, gravityFunction, gravityKickFunction);
+
+		// the steps skip the sleepers, their pull is refreshed now and then so gravity can still wake them
+		if (sleepingEnabled && ++sleepingPullSteps >= sleepSteps) {
+			gravityIntegrator.evaluateSleeping(asteroidParticles, gravityFunction);
+			sleepingPullSteps = 0;
+		}
+	}
+	else {
+		gravityIntegrator.clear();
+	}
+
+	if (maxRadius > 0.0f) {
+		// the broad phase boxes cover the whole step's motion when collisions are continuous
+		float sweepTime = continuousCollisions ? timeStep : 0.0f;
+
+		if (broadPhase == BroadPhase::SweepAndPrune) {
+			collisionSweep.update(asteroidParticles, sweepTime);
+			collisionSweep.findPairs(collisionPairs);
+		}
+		else if (broadPhase == BroadPhase::LinearBVH) {
+			collisionTree.build(asteroidParticles, sweepTime);
+			collisionTree.findPairs(collisionPairs);
+		}
+		else {
+			float maxMotion = maxSpeed * sweepTime;
+
+			// cells twice the largest box so most particles land in a single cell
+			collisionGrid.build(asteroidParticles, 2.0f * (2.0f * maxRadius + maxMotion), sweepTime);
+			collisionGrid.findPairs(collisionPairs);
+		}
+
+		if (!sameAsteroidCollisions) {
+			// only particles of different asteroids collide
+			collisionPairs.erase(std::remove_if(collisionPairs.begin(), collisionPairs.end(), [this](const std::pair<unsigned int, unsigned int>& pair) {
+				return asteroidParticles.parent[pair.first] == asteroidParticles.parent[pair.second];
+			}), collisionPairs.end());
+		}
+
+		// how fast the candidates close in before the contacts stop them sets the next step's substeps
+		pairClosingRate = std::max(pairClosingRate, asteroidParticles.getMaxClosingTravel(collisionPairs, 1.0f));
+
+		// the broad phases leave out pairs of two sleepers, anything else reaching a sleeping island wakes it
+		islandSleep.wakeTouched(asteroidParticles, collisionPairs);
+
+		if (continuousCollisions) {
+			// find the moment each pair first touches during the step
+			findSweptContacts(asteroidParticles, collisionPairs, timeStep, collisionContacts, collisionImpactTimes);
+		}
+		else {
+			// test the candidates several pairs at a time
+			findContacts(asteroidParticles, collisionPairs, collisionContacts);
+		}
+
+		// how hard fragments hit depends on the velocities before the contacts bounce them apart
+		if (fragmentationEnabled) {
+			fragmentation.measureImpacts(asteroidParticles, collisionContacts);
+		}
+		if (accretionEnabled) {
+			accretion.findMerges(asteroidParticles, collisionContacts, accretionSpeed);
+		}
+
+		if (continuousCollisions) {
+			contactSolver.solve(asteroidParticles, collisionContacts, collisionImpactTimes);
+		}
+		else {
+			contactSolver.solve(asteroidParticles, collisionContacts);
+		}
+	}
+	else {
+		collisionContacts.clear();
+	}
+
+	// fragments that met slowly merge into single bodies right away, the absorbed ones are only removed at the end
+	// of the substep so the indices of the step stay valid, and nothing that merged breaks up in the same substep
+	if (accretionEnabled && accretion.merge(asteroidParticles, asteroidDensity) > 0 && fragmentationEnabled) {
+		fragmentation.excludeParticles(accretion.getMergedParticles());
+	}
+
+	if (gravityEnabled) {
+		// drift every fragment and kick each pair on the shorter block timestep of the two
+		gravityIntegrator.finishStep(asteroidParticles, gravityKickFunction);
+		physicsBlockLevel = gravityIntegrator.getDeepestLevel();
+	}
+	else {
+		asteroidParticles.updatePositions(timeStep);
+		physicsBlockLevel = 0;
+	}
+
+	// islands of touching fragments that stayed slow drop out of the following steps until something hits or pulls them
+	if (sleepingEnabled) {
+		islandSleep.update(asteroidParticles, collisionContacts, gravityIntegrator.getAccelerations(), timeStep, sleepSpeed, sleepSteps);
+		physicsAwakeParticles = islandSleep.getAwakeCount();
+	}
+	else {
+		islandSleep.wakeAll(asteroidParticles);
+		physicsAwakeParticles = asteroidParticles.size();
+	}
+
+	// fragments that were hit hard enough break into smaller ones, the extra pieces join from the next substep
+	if (fragmentationEnabled && fragmentation.split(asteroidParticles, fragmentEnergyThreshold, fragmentChildren, maxFragmentDepth) > 0) {
+		particlesJoined = true;
+	}
+
+	// drop the particles absorbed by the merge, splits only add particles behind them so their indices still hold
+	if (accretionEnabled && !accretion.getAbsorbedParticles().empty()) {
+		for (uint32_t i : accretion.getAbsorbedParticles()) {
+			removeParticle(i);
+		}
+
+		// the sweep keeps particle indices between steps
+		collisionSweep.clear();
+	}
+}
+
+void Simulation::despawnEscapedParticles() {
+	bool removed = false;
+
+	// from the back, so the particle moved into a removed one's place has already been checked
+	for (size_t i = asteroidParticles.size(); i-- > 0;) {
+		cy::Vec3f position = asteroidParticles.getPosition(i);
+		bool inside = position.x >= simulationBoundsMin.x && position.y >= simulationBoundsMin.y && position.z >= simulationBoundsMin.z &&
+			position.x <= simulationBoundsMax.x && position.y <= simulationBoundsMax.y && position.z <= simulationBoundsMax.z;
+		if (inside) {
+			continue;
+		}
+
+		removeParticle(i);
+		removed = true;
+	}
+
+	// the sweep keeps particle indices between steps
+	if (removed) {
+		collisionSweep.clear();
+	}
+}
+
+void Simulation::removeParticle(size_t i) {
+	// the last particle moves into i's place, everything that keeps per particle state follows it
+	islandSleep.removeParticle(asteroidParticles, (uint32_t)i);
+	gravityIntegrator.removeParticle(asteroidParticles, (uint32_t)i);
+	asteroidParticles.remove(i);
+}
+
+void Simulation::buildGravity() {
+	// the cells of the tree are found once per substep, the grid keeps nothing between evaluations
+	if (gravitySolver == GravitySolver::BarnesHut) {
+		gravityTree.build(asteroidParticles);
+	}
+}
+
+void Simulation::computeGravity(const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations) {
+	// the sources are moved to where the particles are now before every evaluation
+	if (gravitySolver == GravitySolver::ParticleMesh) {
+		gravityMesh.build(particles, gravitationalConstant, gravityGridResolution);
+		gravityMesh.computeAccelerations(particles, active, accelerations);
+	}
+	else {
+		gravityTree.refit(particles);
+		gravityTree.computeAccelerations(particles, active, gravitationalConstant, gravityOpeningAngle, gravitySoftening, accelerations);
+	}
+}
+
+void Simulation::computeGravityKicks(const ParticleStore& particles, const std::vector<uint32_t>& targets, const std::vector<unsigned char>& levels, const float* pairKicks, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations) {
+	if (gravitySolver == GravitySolver::ParticleMesh) {
+		// every fragment is on the same level, so each pair's time is the target's own
+		gravityMesh.build(particles, gravitationalConstant, gravityGridResolution);
+		gravityMesh.computeAccelerations(particles, targets, kicks);
+		if (accelerations) {
+			*accelerations = kicks;
+		}
+		for (size_t n = 0; n < targets.size(); n++) {
+			kicks[n] *= pairKicks[levels[targets[n]]];
+		}
+	}
+	else {
+		gravityTree.refit(particles, levels, BlockTimestepIntegrator::maxLevel + 1);
+		gravityTree.computeKicks(particles, targets, pairKicks, gravitationalConstant, gravityOpeningAngle, gravitySoftening, kicks, accelerations);
+	}
+}
+
+void Simulation::collideParentBodies() {
+	// sort the intact asteroids along x, so each is only tested against the ones its x extent overlaps
+	parentBodyOrder.clear();
+	for (uint32_t b = 0; b < parentBodies.size(); b++) {
+		if (!parentBodies[b].exploded) {
+			parentBodyOrder.push_back(b);
+		}
+	}
+	std::sort(parentBodyOrder.begin(), parentBodyOrder.end(), [this](uint32_t a, uint32_t b) {
+		return parentBodies[a].modelMatrix.GetTranslation().x - parentBodies[a].radius < parentBodies[b].modelMatrix.GetTranslation().x - parentBodies[b].radius;
+	});
+
+	for (size_t n = 0; n < parentBodyOrder.size(); n++) {
+		const ParentBody& first = parentBodies[parentBodyOrder[n]];
+		cy::Vec3f firstCenter = first.modelMatrix.GetTranslation();
+
+		for (size_t m = n + 1; m < parentBodyOrder.size(); m++) {
+			const ParentBody& second = parentBodies[parentBodyOrder[m]];
+			cy::Vec3f secondCenter = second.modelMatrix.GetTranslation();
+			if (secondCenter.x - second.radius > firstCenter.x + first.radius) {
+				break;
+			}
+
+			// compare the distance between the model's centers, asteroids exploding this step still hit the others they touch
+			cy::Vec3f offset = secondCenter - firstCenter;
+			float radiusSum = first.radius + second.radius;
+			if (offset.Dot(offset) > radiusSum * radiusSum) {
+				continue;
+			}
+
+			// both break up where their surfaces meet
+			cy::Vec3f impactPoint = firstCenter + offset * (first.radius / radiusSum);
+			placementFragments.clear();
+			explodeParentBody(parentBodyOrder[n], impactPoint);
+			explodeParentBody(parentBodyOrder[m], impactPoint);
+
+			// the fragments of both are prepared around the same point of impact, so they are moved apart together
+			if (separateSpawnedFragments && !placementFragments.empty()) {
+				std::sort(placementFragments.begin(), placementFragments.end());
+				fragmentPlacement.place(fragmentSpawner.getPrepared(), placementFragments, placementAttempts, scenarioSeed);
+			}
+		}
+	}
+}
+
+void Simulation::explodeParentBody(size_t b, const cy::Vec3f& impactPoint) {
+	ParentBody& body = parentBodies[b];
+	if (body.exploded) {
+		return;
+	}
+
+	body.exploded = true;
+	fragmentSpawner.start(body.fragmentsBegin, body.fragmentsEnd, impactPoint);
+
+	for (size_t i = body.fragmentsBegin; i < body.fragmentsEnd; i++) {
+		placementFragments.push_back((uint32_t)i);
+	}
+}
@@ -0,0 +1,193 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "cyMatrix.h"
+#include "ParticleStore.h"
+#include "SpatialHashGrid.h"
+#include "SweepAndPrune.h"
+#include "LinearBVH.h"
+#include "ContactSolver.h"
+#include "BarnesHutTree.h"
+#include "ParticleMeshGravity.h"
+#include "BlockTimestepIntegrator.h"
+#include "IslandSleep.h"
+#include "Fragmentation.h"
+#include "Accretion.h"
+#include "FragmentSpawner.h"
+#include "FragmentGenerator.h"
+#include "PoissonDiskPlacement.h"
+
+/// <summary>
+/// An asteroid that flies whole until it hits another one and then breaks into its fragments
+/// </summary>
+struct ParentBody {
+	cy::Vec3f startPosition = cy::Vec3f(0.0f, 0.0f, 0.0f);
+	cy::Vec3f velocity = cy::Vec3f(0.0f, 0.0f, 0.0f); // distance per reference step
+	float scale = 1.0f;
+	unsigned int fragmentCount = 0;
+	FragmentDistribution fragments; // positions are relative to the point of impact
+
+	// set by Simulation::reset
+	cy::Matrix4f modelMatrix = cy::Matrix4f(1.0f);
+	cy::Vec3f previousPosition = cy::Vec3f(0.0f, 0.0f, 0.0f);
+	float radius = 0.0f;
+	bool exploded = false;
+	size_t fragmentsBegin = 0; // its fragments among the prepared ones of the spawner
+	size_t fragmentsEnd = 0;
+};
+
+// fragment collisions
+enum class BroadPhase {
+	SpatialHash,   // rebuilt every step, best when fragments move far between steps
+	SweepAndPrune, // kept between steps, best when fragments barely move
+	LinearBVH      // rebuilt every step on all cores, best for large clouds of uneven density
+};
+
+// fragment gravity
+enum class GravitySolver {
+	BarnesHut,   // accurate at every distance, best for clumpy or sparse debris
+	ParticleMesh // grid based, best for dense and roughly uniform debris clouds
+};
+
+/// <summary>
+/// One asteroid collision scenario and everything its physics keeps between steps. Instances share nothing
+/// but the thread pool behind parallelFor, so several of them can be stepped at once, each from its own
+/// thread. The settings are plain members, change them between steps or before a reset.
+/// </summary>
+class Simulation {
+public:
+	Simulation();
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// the asteroids of the scenario, the particle parents are indices into them, takes effect on the next reset
+	void setParentBodies(const std::vector<ParentBody>& bodies) { parentBodies = bodies; }
+
+	// put the asteroids back at their start and generate their explosions again
+	void reset();
+
+	// advance by steps fixed steps of 1 / stepRate seconds each
+	void step(unsigned int steps);
+
+	// the asteroids only fly towards each other while moving, the fragments simulate either way
+	void setParentsMoving(bool moving) { parentsMoving = moving; }
+
+	const ParticleStore& getParticles() const { return asteroidParticles; }
+	const std::vector<ParentBody>& getParentBodies() const { return parentBodies; }
+
+	// telemetry of the last step
+	unsigned int getSubsteps() const { return physicsSubsteps; }
+	unsigned int getBlockLevel() const { return physicsBlockLevel; }
+	size_t getAwakeParticles() const { return physicsAwakeParticles; }
+	float getStepMilliseconds() const { return physicsStepMilliseconds; }
+
+	// shared asteroid model
+	float asteroidModelRadius = 1.0f; // bounding radius of the asteroid model at scale 1, so fragment radii do not walk the mesh
+	float asteroidDensity = 1000.0f;
+
+	// explosion spawning
+	uint64_t scenarioSeed = 20230424; // every fragment's random values come from this seed, the same seed gives the same explosion
+	unsigned int spawnBatchSize = 0; // fragments added per step after the impact, 0 adds the whole explosion on the impact step
+
+	bool separateSpawnedFragments = true; // move new fragments apart so none starts inside another, which would bounce them all on the first steps
+	unsigned int placementAttempts = 30;  // candidate positions a fragment tries before it is left overlapping
+
+	// simulation bounds, fragments that leave them are removed and their memory reused
+	cy::Vec3f simulationBoundsMin = cy::Vec3f(-100.0f, -100.0f, -100.0f); // the far plane is 100 units out
+	cy::Vec3f simulationBoundsMax = cy::Vec3f(100.0f, 100.0f, 100.0f);
+
+	// fragment collisions
+	BroadPhase broadPhase = BroadPhase::SpatialHash;
+
+	bool sameAsteroidCollisions = true; // particles also collide with particles of their own asteroid
+	bool continuousCollisions = false;  // sweep the spheres along each step's motion so fast fragments cannot pass through each other, needed for large steps
+
+	// sleeping fragments
+	bool sleepingEnabled = true;
+	float sleepSpeed = 0.02f;       // fragments moving less than this many of their island's smallest radius per reference step count as resting
+	unsigned int sleepSteps = 60;   // an island of touching fragments sleeps once all of them rested this many steps, the pull on sleepers is checked as often
+
+	// fragmentation cascade
+	bool fragmentationEnabled = false;       // off by default, the gravity of a dense debris cloud makes enough impacts pass the threshold to fill the pool within a few steps
+	float fragmentEnergyThreshold = 0.001f;  // impact energy per unit mass that breaks a fragment, in squared distance per reference step
+	unsigned int fragmentChildren = 4;       // pieces a breaking fragment splits into
+	unsigned int maxFragmentDepth = 3;       // times the pieces of the first explosion can break again
+	unsigned int particlePoolSize = 100000;  // particles reserved up front so a cascade never allocates, splits stop once it is used up
+
+	// accretion
+	bool accretionEnabled = false;
+	float accretionSpeed = 0.002f; // fragments meeting slower than this relative to each other merge into one body
+
+	// fragment gravity
+	bool gravityEnabled = false; // off by default, the block timesteps of a dense debris cloud take several times the 60 Hz step budget on a few cores
+	GravitySolver gravitySolver = GravitySolver::BarnesHut;
+	float gravitationalConstant = 0.01f;    // in simulation units, the fragment masses are tiny so this is far above the real constant
+	float gravityOpeningAngle = 0.5f;       // larger is faster but less accurate, 0 sums every pair
+	float gravitySoftening = 0.01f;         // keeps the pull between nearly touching fragments finite
+	unsigned int gravityGridResolution = 64; // grid points along each axis of the debris cloud, rounded up to a power of two
+	float gravityStepAccuracy = 0.1f;        // smaller gives fragments under a strong pull shorter block timesteps
+
+	// fixed timestep
+	float stepRate = 60.0f; // steps per simulated second, lower saves CPU
+
+	// adaptive substeps
+	float maxTravelPerSubstep = 1.0f; // a substep closes no pair in further than this many of their radii summed, a block timestep moves no particle further than this many of its own
+	unsigned int maxSubsteps = 8;     // caps the cost of the most violent steps
+
+private:
+	void stepPhysics(float timeStep);
+	void updateParticles(float timeStep);
+	void buildGravity();
+	void computeGravity(const ParticleStore& particles, const std::vector<uint32_t>& active, std::vector<cy::Vec3f>& accelerations);
+	void computeGravityKicks(const ParticleStore& particles, const std::vector<uint32_t>& targets, const std::vector<unsigned char>& levels, const float* pairKicks, std::vector<cy::Vec3f>& kicks, std::vector<cy::Vec3f>* accelerations);
+	void despawnEscapedParticles();
+	void removeParticle(size_t i);
+	void collideParentBodies();
+	void explodeParentBody(size_t b, const cy::Vec3f& impactPoint);
+
+	std::vector<ParentBody> parentBodies;
+	std::vector<uint32_t> parentBodyOrder; // intact asteroids sorted along x for the collision sweep
+	bool parentsMoving = false;
+
+	// particles of all asteroids
+	ParticleStore asteroidParticles;
+
+	FragmentSpawner fragmentSpawner; // fragments of every asteroid, generated ahead of the impacts
+	PoissonDiskPlacement fragmentPlacement;
+	std::vector<uint32_t> placementFragments; // prepared fragments of the asteroids exploding at one impact
+
+	SpatialHashGrid collisionGrid;
+	SweepAndPrune collisionSweep;
+	LinearBVH collisionTree;
+
+	std::vector<std::pair<unsigned int, unsigned int>> collisionPairs;
+	std::vector<std::pair<unsigned int, unsigned int>> collisionContacts;
+	std::vector<float> collisionImpactTimes;
+
+	ContactSolver contactSolver;
+	IslandSleep islandSleep;
+	Fragmentation fragmentation;
+	Accretion accretion;
+
+	BarnesHutTree gravityTree;
+	ParticleMeshGravity gravityMesh;
+	BlockTimestepIntegrator gravityIntegrator;
+	BlockTimestepIntegrator::AccelerationFunction gravityFunction; // computeGravity of this instance
+	BlockTimestepIntegrator::KickFunction gravityKickFunction;     // computeGravityKicks of this instance
+	unsigned int sleepingPullSteps = 0; // substeps since the pull on the sleepers was evaluated
+
+	float pairClosingRate = 0.0f;          // fastest any broad phase pair closed in on each other during the last step, in their radii summed per unit time
+	bool particlesJoined = true;           // fragments joined since the last step, nothing is known about their contacts yet
+	unsigned int physicsSubsteps = 1;      // substeps the last step took
+	unsigned int blockLevelLimit = BlockTimestepIntegrator::maxLevel; // deepest block timestep level the substeps leave room for
+	unsigned int physicsBlockLevel = 0;    // deepest block timestep level of the last substep
+	size_t physicsAwakeParticles = 0;      // particles the last substep integrated
+	float physicsStepMilliseconds = 0.0f; // time the last step took
+};
+
+#endif
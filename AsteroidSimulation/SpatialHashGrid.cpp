@@ -0,0 +1,158 @@
+#include <cmath>
+#include <algorithm>
+#include "SpatialHashGrid.h"
+#include "Parallel.h"
+
+SpatialHashGrid::SpatialHashGrid() {
+	inverseCellSize = 1.0f;
+	tableMask = 0;
+	tableBits = 0;
+}
+
+void SpatialHashGrid::build(const ParticleStore& particles, float cellSize, float sweepTime) {
+	unsigned int particleCount = (unsigned int)particles.size();
+	inverseCellSize = 1.0f / cellSize;
+
+	boundsMin.resize(particleCount);
+	boundsMax.resize(particleCount);
+	entryOffsets.resize(particleCount + 1);
+
+	// count how many cells each bounding box overlaps
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			particles.getBounds(i, sweepTime, boundsMin[i], boundsMax[i]);
+
+			Cell low = getCell(boundsMin[i]);
+			Cell high = getCell(boundsMax[i]);
+			entryOffsets[i + 1] = (high.x - low.x + 1) * (high.y - low.y + 1) * (high.z - low.z + 1);
+		}
+	});
+
+	entryOffsets[0] = 0;
+	for (unsigned int i = 0; i < particleCount; i++) {
+		entryOffsets[i + 1] += entryOffsets[i];
+	}
+	unsigned int entryCount = entryOffsets[particleCount];
+
+	// about one bucket per entry keeps collisions between cells rare
+	tableBits = 6;
+	while ((1u << tableBits) < entryCount) {
+		tableBits++;
+	}
+	tableMask = (1u << tableBits) - 1;
+
+	// insert each bounding box into every cell it overlaps
+	entries.resize(entryCount);
+	entryBuckets.resize(entryCount);
+	entryOrder.resize(entryCount);
+	parallelFor(particleCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			Cell low = getCell(boundsMin[i]);
+			Cell high = getCell(boundsMax[i]);
+
+			unsigned int e = entryOffsets[i];
+			uint32_t sleeping = particles.asleep[i] ? 1 : 0;
+			Entry entry;
+			entry.particle = i;
+			for (entry.cell.x = low.x; entry.cell.x <= high.x; entry.cell.x++) {
+				for (entry.cell.y = low.y; entry.cell.y <= high.y; entry.cell.y++) {
+					for (entry.cell.z = low.z; entry.cell.z <= high.z; entry.cell.z++) {
+						entries[e] = entry;
+						entryBuckets[e] = (hashCell(entry.cell) << 1) | sleeping;
+						entryOrder[e] = e;
+						e++;
+					}
+				}
+			}
+		}
+	});
+
+	// group the entries by bucket with the sleepers last, the sort is stable so the order does not depend on the thread count
+	parallelRadixSort(entryBuckets, entryOrder, bucketScratch, orderScratch, tableBits + 1);
+
+	sortedEntries.resize(entryCount);
+	parallelFor(entryCount, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int k = begin; k < end; k++) {
+			sortedEntries[k] = entries[entryOrder[k]];
+		}
+	});
+}
+
+void SpatialHashGrid::findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const {
+	pairs.clear();
+
+	unsigned int entryCount = (unsigned int)sortedEntries.size();
+	unsigned int chunkCount = std::max(1u, std::min(4 * getWorkerCount(), entryCount));
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> chunkPairs(chunkCount);
+
+	parallelFor(chunkCount, [&](unsigned int firstChunk, unsigned int lastChunk) {
+		for (unsigned int chunk = firstChunk; chunk < lastChunk; chunk++) {
+			unsigned int begin = (unsigned int)((unsigned long long)entryCount * chunk / chunkCount);
+			unsigned int end = (unsigned int)((unsigned long long)entryCount * (chunk + 1) / chunkCount);
+
+			// a chunk owns the buckets that start inside it
+			while (begin > 0 && begin < entryCount && (entryBuckets[begin] >> 1) == (entryBuckets[begin - 1] >> 1)) {
+				begin++;
+			}
+			while (end > 0 && end < entryCount && (entryBuckets[end] >> 1) == (entryBuckets[end - 1] >> 1)) {
+				end++;
+			}
+
+			unsigned int bucketBegin = begin;
+			while (bucketBegin < end) {
+				unsigned int bucketEnd = bucketBegin + 1;
+				while (bucketEnd < entryCount && (entryBuckets[bucketEnd] >> 1) == (entryBuckets[bucketBegin] >> 1)) {
+					bucketEnd++;
+				}
+
+				// the sleepers at the end of the bucket only pair up with the awake entries before them
+				for (unsigned int a = bucketBegin; a < bucketEnd && !(entryBuckets[a] & 1); a++) {
+					const Entry& first = sortedEntries[a];
+
+					for (unsigned int b = a + 1; b < bucketEnd; b++) {
+						const Entry& second = sortedEntries[b];
+
+						// buckets are shared by colliding hashes, so make sure it is really the same cell
+						if (first.cell.x != second.cell.x || first.cell.y != second.cell.y || first.cell.z != second.cell.z) {
+							continue;
+						}
+
+						unsigned int i = std::min(first.particle, second.particle);
+						unsigned int j = std::max(first.particle, second.particle);
+
+						cy::Vec3f overlapMin(std::max(boundsMin[i].x, boundsMin[j].x), std::max(boundsMin[i].y, boundsMin[j].y), std::max(boundsMin[i].z, boundsMin[j].z));
+						cy::Vec3f overlapMax(std::min(boundsMax[i].x, boundsMax[j].x), std::min(boundsMax[i].y, boundsMax[j].y), std::min(boundsMax[i].z, boundsMax[j].z));
+
+						if (overlapMin.x > overlapMax.x || overlapMin.y > overlapMax.y || overlapMin.z > overlapMax.z) {
+							continue;
+						}
+
+						// boxes sharing several cells are reported once, by the cell holding the corner of their overlap
+						Cell owner = getCell(overlapMin);
+						if (owner.x == first.cell.x && owner.y == first.cell.y && owner.z == first.cell.z) {
+							chunkPairs[chunk].push_back(std::make_pair(i, j));
+						}
+					}
+				}
+
+				bucketBegin = bucketEnd;
+			}
+		}
+	});
+
+	for (const std::vector<std::pair<unsigned int, unsigned int>>& chunk : chunkPairs) {
+		pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+	}
+}
+
+SpatialHashGrid::Cell SpatialHashGrid::getCell(const cy::Vec3f& point) const {
+	Cell cell;
+	cell.x = (int)std::floor(point.x * inverseCellSize);
+	cell.y = (int)std::floor(point.y * inverseCellSize);
+	cell.z = (int)std::floor(point.z * inverseCellSize);
+	return cell;
+}
+
+uint32_t SpatialHashGrid::hashCell(const Cell& cell) const {
+	return ((uint32_t)cell.x * 73856093u ^ (uint32_t)cell.y * 19349663u ^ (uint32_t)cell.z * 83492791u) & tableMask;
+}
@@ -0,0 +1,55 @@
+#ifndef SPATIAL_HASH_GRID_H
+#define SPATIAL_HASH_GRID_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Uniform grid broad phase for particle collisions. Every particle's bounding box is hashed
+/// into the cells it overlaps, so only particles sharing a cell are paired up. The sleeping particles of
+/// a bucket come after its awake ones and only the awake ones are tested, so two sleepers are never paired.
+/// </summary>
+class SpatialHashGrid {
+public:
+	SpatialHashGrid();
+
+	// rebuild the grid over the boxes the particles sweep in sweepTime, cellSize must be at least the largest
+	// box so a box touches at most 8 cells, around twice that keeps the number of multi-cell boxes low
+	void build(const ParticleStore& particles, float cellSize, float sweepTime);
+
+	// collect every pair (i, j) with i < j whose bounding boxes overlap and that are not both asleep
+	void findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const;
+
+private:
+	struct Cell {
+		int x, y, z;
+	};
+
+	struct Entry {
+		Cell cell;
+		unsigned int particle;
+	};
+
+	Cell getCell(const cy::Vec3f& point) const;
+	uint32_t hashCell(const Cell& cell) const;
+
+	float inverseCellSize;
+	uint32_t tableMask;
+	int tableBits;
+
+	std::vector<cy::Vec3f> boundsMin;
+	std::vector<cy::Vec3f> boundsMax;
+	std::vector<unsigned int> entryOffsets; // first entry of each particle, particle count + 1 entries
+
+	std::vector<Entry> entries;
+	std::vector<uint32_t> entryBuckets;   // bucket shifted left once, low bit set for sleeping particles
+	std::vector<uint32_t> entryOrder;
+	std::vector<uint32_t> bucketScratch;
+	std::vector<uint32_t> orderScratch;
+	std::vector<Entry> sortedEntries; // entries grouped by bucket
+};
+
+#endif
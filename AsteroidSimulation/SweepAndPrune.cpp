@@ -0,0 +1,148 @@
+#include <algorithm>
+#include "SweepAndPrune.h"
+
+void SweepAndPrune::update(const ParticleStore& particles, float sweepTime) {
+	bool sameParticles = boundsMin.size() == particles.size();
+
+	boundsMin.resize(particles.size());
+	boundsMax.resize(particles.size());
+	sleeping.resize(particles.size());
+	for (size_t i = 0; i < particles.size(); i++) {
+		particles.getBounds(i, sweepTime, boundsMin[i], boundsMax[i]);
+		sleeping[i] = particles.asleep[i];
+	}
+
+	if (!sameParticles) {
+		rebuild();
+		return;
+	}
+
+	// particles only moved a little, so the endpoints are nearly sorted already
+	for (int axis = 0; axis < 3; axis++) {
+		for (Endpoint& endpoint : endpoints[axis]) {
+			endpoint.value = getBound(endpoint.data, axis);
+		}
+		sortAxis(axis);
+	}
+}
+
+void SweepAndPrune::clear() {
+	boundsMin.clear();
+	boundsMax.clear();
+	sleeping.clear();
+	for (int axis = 0; axis < 3; axis++) {
+		endpoints[axis].clear();
+	}
+	overlapPairs.clear();
+}
+
+void SweepAndPrune::findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const {
+	pairs.clear();
+	pairs.reserve(overlapPairs.size());
+
+	for (uint64_t key : overlapPairs) {
+		unsigned int i = (unsigned int)(key >> 32);
+		unsigned int j = (unsigned int)(key & 0xffffffffu);
+		if (!sleeping[i] || !sleeping[j]) {
+			pairs.push_back(std::make_pair(i, j));
+		}
+	}
+
+	// the set's order depends on its hashing, sorted pairs keep the contacts the same on every run
+	std::sort(pairs.begin(), pairs.end());
+}
+
+void SweepAndPrune::rebuild() {
+	unsigned int particleCount = (unsigned int)boundsMin.size();
+
+	for (int axis = 0; axis < 3; axis++) {
+		std::vector<Endpoint>& axisEndpoints = endpoints[axis];
+		axisEndpoints.resize(2 * particleCount);
+
+		for (unsigned int i = 0; i < particleCount; i++) {
+			axisEndpoints[2 * i].data = (i << 1) | 1;
+			axisEndpoints[2 * i].value = boundsMin[i][axis];
+			axisEndpoints[2 * i + 1].data = i << 1;
+			axisEndpoints[2 * i + 1].value = boundsMax[i][axis];
+		}
+
+		std::sort(axisEndpoints.begin(), axisEndpoints.end(), endpointLess);
+	}
+
+	// sweep along x keeping the boxes that are open, and test those against every newly opened box
+	overlapPairs.clear();
+	std::vector<unsigned int> open;
+	for (const Endpoint& endpoint : endpoints[0]) {
+		unsigned int particle = endpoint.data >> 1;
+
+		if (endpoint.data & 1) {
+			for (unsigned int other : open) {
+				if (overlaps(particle, other)) {
+					overlapPairs.insert(makeKey(particle, other));
+				}
+			}
+			open.push_back(particle);
+		}
+		else {
+			std::vector<unsigned int>::iterator opened = std::find(open.begin(), open.end(), particle);
+			if (opened != open.end()) {
+				open.erase(opened);
+			}
+		}
+	}
+}
+
+void SweepAndPrune::sortAxis(int axis) {
+	std::vector<Endpoint>& axisEndpoints = endpoints[axis];
+
+	// insertion sort, every swap is a pair whose overlap along this axis changed
+	for (size_t i = 1; i < axisEndpoints.size(); i++) {
+		Endpoint endpoint = axisEndpoints[i];
+		size_t j = i;
+
+		while (j > 0 && endpointLess(endpoint, axisEndpoints[j - 1])) {
+			const Endpoint& passed = axisEndpoints[j - 1];
+			unsigned int particle = endpoint.data >> 1;
+			unsigned int other = passed.data >> 1;
+
+			if ((endpoint.data & 1) && !(passed.data & 1)) {
+				// a minimum moved below a maximum, the boxes may overlap now
+				if (overlaps(particle, other)) {
+					overlapPairs.insert(makeKey(particle, other));
+				}
+			}
+			else if (!(endpoint.data & 1) && (passed.data & 1)) {
+				// a maximum moved below a minimum, the boxes are separated along this axis
+				overlapPairs.erase(makeKey(particle, other));
+			}
+
+			axisEndpoints[j] = passed;
+			j--;
+		}
+
+		axisEndpoints[j] = endpoint;
+	}
+}
+
+bool SweepAndPrune::endpointLess(const Endpoint& a, const Endpoint& b) {
+	// at equal values minimums come first, so a box of zero width opens before it closes and touching boxes overlap
+	return a.value < b.value || (a.value == b.value && (a.data & 1) > (b.data & 1));
+}
+
+bool SweepAndPrune::overlaps(unsigned int i, unsigned int j) const {
+	return boundsMin[i].x <= boundsMax[j].x && boundsMin[j].x <= boundsMax[i].x &&
+		boundsMin[i].y <= boundsMax[j].y && boundsMin[j].y <= boundsMax[i].y &&
+		boundsMin[i].z <= boundsMax[j].z && boundsMin[j].z <= boundsMax[i].z;
+}
+
+float SweepAndPrune::getBound(unsigned int data, int axis) const {
+	unsigned int particle = data >> 1;
+	return (data & 1) ? boundsMin[particle][axis] : boundsMax[particle][axis];
+}
+
+uint64_t SweepAndPrune::makeKey(unsigned int i, unsigned int j) {
+	if (i > j) {
+		std::swap(i, j);
+	}
+	return ((uint64_t)i << 32) | j;
+}
@@ -0,0 +1,52 @@
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <unordered_set>
+#include "cyVector.h"
+#include "ParticleStore.h"
+
+/// <summary>
+/// Incremental sweep and prune broad phase. The sorted bounding box endpoints on each axis and the
+/// set of overlapping pairs are kept between steps, so an update only pays for the endpoints that swapped.
+/// The pairs are still handed out whole and sorted every step. Sleepers do not move, so they never swap with
+/// each other and their pairs are simply left out of the result.
+/// </summary>
+class SweepAndPrune {
+public:
+	// move the endpoints to the boxes the particles sweep in sweepTime, the particle indices must refer to the
+	// same particles as the last update
+	void update(const ParticleStore& particles, float sweepTime);
+
+	// forget every particle, the next update rebuilds from scratch
+	void clear();
+
+	// collect every pair (i, j) with i < j whose bounding boxes overlap and that were not both asleep at the last update
+	void findPairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs) const;
+
+private:
+	struct Endpoint {
+		float value;
+		unsigned int data; // particle index shifted left once, low bit set for the minimum endpoint
+	};
+
+	void rebuild();
+	void sortAxis(int axis);
+	bool overlaps(unsigned int i, unsigned int j) const;
+	float getBound(unsigned int data, int axis) const;
+
+	static bool endpointLess(const Endpoint& a, const Endpoint& b);
+	static uint64_t makeKey(unsigned int i, unsigned int j);
+
+	std::vector<cy::Vec3f> boundsMin;
+	std::vector<cy::Vec3f> boundsMax;
+	std::vector<unsigned char> sleeping;
+
+	std::vector<Endpoint> endpoints[3];
+
+	std::unordered_set<uint64_t> overlapPairs;
+};
+
+#endif
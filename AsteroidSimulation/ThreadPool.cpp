@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+namespace {
+	// queue owned by the current thread, threads outside any pool share the last queue
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local unsigned int currentQueue = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount) : queuedJobs(0), stopping(false) {
+	unsigned int workerCount = threadCount > 1 ? threadCount - 1 : 0;
+
+	for (unsigned int i = 0; i <= workerCount; i++) {
+		queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeWorkers.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(unsigned int taskCount, const std::function<void(unsigned int index)>& task) {
+	if (taskCount == 0) {
+		return;
+	}
+	if (workers.empty() || taskCount == 1) {
+		for (unsigned int i = 0; i < taskCount; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	unsigned int queue = currentPool == this ? currentQueue : (unsigned int)workers.size();
+	std::atomic<unsigned int> remaining(taskCount);
+
+	// count the jobs before they can be taken so the count never drops below zero
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedJobs += taskCount;
+	}
+
+	// push in reverse so the owner pops index 0 first and thieves take the last indices
+	{
+		std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+		for (unsigned int i = taskCount; i-- > 0;) {
+			Job job = { &task, i, &remaining };
+			queues[queue]->jobs.push_back(job);
+		}
+	}
+	wakeWorkers.notify_all();
+
+	// help out until every job of this batch is done
+	while (remaining.load(std::memory_order_acquire) > 0) {
+		Job job;
+		if (findJob(queue, job)) {
+			execute(job);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::workerLoop(unsigned int queue) {
+	currentPool = this;
+	currentQueue = queue;
+
+	while (true) {
+		Job job;
+		if (findJob(queue, job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeWorkers.wait(lock, [this] { return stopping || queuedJobs > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::findJob(unsigned int queue, Job& job) {
+	// newest job from our own queue first, it is most likely still in cache
+	{
+		WorkQueue& own = *queues[queue];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			queuedJobs--;
+			return true;
+		}
+	}
+
+	// otherwise steal the oldest job from someone else
+	unsigned int queueCount = (unsigned int)queues.size();
+	for (unsigned int offset = 1; offset < queueCount; offset++) {
+		WorkQueue& victim = *queues[(queue + offset) % queueCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			queuedJobs--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::execute(const Job& job) {
+	(*job.task)(job.index);
+	job.remaining->fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/// <summary>
+/// Work stealing thread pool. Every worker has its own queue and takes its newest job first, idle
+/// workers steal the oldest job from another queue. A thread that runs a batch helps until it is done,
+/// so batches can be started from inside a job.
+/// </summary>
+class ThreadPool {
+public:
+	// threadCount includes the thread that calls run, so threadCount - 1 workers are started
+	explicit ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int getThreadCount() const { return (unsigned int)workers.size() + 1; }
+
+	// run task(index) for every index in [0, taskCount) and return once all of them finished
+	void run(unsigned int taskCount, const std::function<void(unsigned int index)>& task);
+
+private:
+	struct Job {
+		const std::function<void(unsigned int)>* task;
+		unsigned int index;
+		std::atomic<unsigned int>* remaining;
+	};
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void workerLoop(unsigned int queue);
+	bool findJob(unsigned int queue, Job& job);
+	void execute(const Job& job);
+
+	std::vector<std::unique_ptr<WorkQueue>> queues; // one per worker, the last one is shared by outside threads
+	std::vector<std::thread> workers;
+
+	std::mutex sleepMutex;
+	std::condition_variable wakeWorkers;
+	std::atomic<unsigned int> queuedJobs;
+	bool stopping;
+};
+
+#endif
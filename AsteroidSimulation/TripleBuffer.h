@@ -0,0 +1,49 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/// <summary>
+/// Lock free triple buffer for one writer thread and one reader thread. The writer fills the back
+/// buffer and publishes it, the reader takes the newest published buffer. Neither side ever waits,
+/// the reader skips buffers it was too slow for and keeps the last one when nothing new was published.
+/// </summary>
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : shared(1), front(0), back(2) {}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// buffer the writer fills before the next publish
+	T& getWriteBuffer() { return buffers[back]; }
+
+	// hand the write buffer to the reader and take the one it is not using
+	void publish() {
+		back = shared.exchange(back | freshFlag, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// switch to the newest published buffer, returns false if nothing was published since the last call
+	bool update() {
+		if ((shared.load(std::memory_order_relaxed) & freshFlag) == 0) {
+			return false;
+		}
+		front = shared.exchange(front, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	// buffer the reader draws from, stays the same until the next update
+	const T& getReadBuffer() const { return buffers[front]; }
+
+private:
+	static const unsigned int indexMask = 3;
+	static const unsigned int freshFlag = 4; // set while the shared buffer holds data the reader has not taken
+
+	T buffers[3];
+	std::atomic<unsigned int> shared; // index of the buffer between the writer and the reader
+	unsigned int front;               // only touched by the reader
+	unsigned int back;                // only touched by the writer
+};
+
+#endif